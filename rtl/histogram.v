@@ -6,28 +6,48 @@
 //
 // Purpose:	Generate a bus readable histogram from the data given to us
 //
-//	So, here's how this works: We keep track of two memory areas, ping
-//	and pong.  On a reset, ...
+//	So, here's how this works: We keep track of three memory areas, which
+//	take turns being active, idle, and cleared.
 //
-//	1. On a reset, we clear the current memory area.
-//		- A reset can be triggered externally by writing to the memory
-//			in question.
+//	1. On a reset, we clear all three memory areas.
+//		- A reset can be triggered externally by writing to the core.
 //	2. Once cleared, we count the number of times each sample has been
-//		received.
+//		received into the active memory area.
 //	3. Once NAVGS samples have been counted into the histogram, we ...
 //		A. Trigger an interrupt
-//		B. Swap memory areas, making the first area available to be
-//			read over the WB bus
-//		C. Start clearing the new memory as part of (2) above and
+//		B. Rotate memory areas, making the active area available to be
+//			read over the WB bus, and handing the area that was
+//			idle off to be cleared.
+//		C. Start counting into the area that was just cleared, from
+//			(2) above.
 //	4. Repeat from (2) above
 //
+//	The area being cleared is zeroed in the background, one bin per
+//	clock, through its otherwise unused write port.  It therefore has
+//	the full window to finish, and is always clear before it becomes
+//	active.  No samples are dropped at the swap, and so successive
+//	histograms are gap free, even at the full system clock rate.  This
+//	does require that NAVGS be at least as large as the number of bins.
+//
+//	Each memory area has its own read port.  The bus therefore reads
+//	from the idle area without ever stalling, or being stalled by, the
+//	accumulation taking place in the active area.
+//
+//	The core also keeps, for each memory area, a 32-bit occupancy map,
+//	having one bit per 1/32nd of the histogram (i.e. per 32 bins, when
+//	AW=10).  A bit is set once any bin within that block has counted a
+//	sample.  The map of the idle area is given by o_occupancy, so that a
+//	host may read only those blocks that contain counts.
+//
 //	As currently built, the number of averages is not configurable.
-//	Neither is there a way to clear both buffers--only the current buffer.
 //
 // Usage:	A core might use this histogram by waiting for the interrupt,
-//		and then copying the histogram from the memory.  If you want
-//	to sync to the core, then write (any value) to the core and wait for
-//	the interrupt--at which point you can read the values from the core.
+//		and then copying the histogram from the memory.  The copy
+//	has until the next interrupt, a full NAVGS samples later, to complete.
+//	If the interrupt arrives during the copy, the copy will contain parts
+//	of two histograms and should be repeated.  If you want to sync to the
+//	core, then write (any value) to the core and wait for the interrupt--at
+//	which point you can read the values from the core.
 //
 // Performance:	This core is designed around a block-RAM implementation, and
 //		a block histogram count.  This means that the histogram is not
@@ -40,7 +60,7 @@
 //
 //	102	Flip-Flops
 //	167	LUTs
-//	  8	RAMB36E1's	(i.e. 4k RAM words, each of 17 bits)
+//	 12	RAMB36E1's	(i.e. 3x 4k RAM words, each of 18 bits)
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -78,7 +98,7 @@ module	histogram #(
 		localparam	ACCW = $clog2(NAVGS+1),
 		localparam	DW = 32,
 		parameter	AW = 12,
-		localparam	MEMSZ = (1<<(AW+1))
+		localparam	MEMSZ = (1<<AW)
 		// }}}
 	) (
 		// {{{
@@ -131,13 +151,14 @@ module	histogram #(
 		input	wire		i_ce,
 		input	wire [AW-1:0]	i_sample,
 		//
-		output	reg		o_int
+		output	reg		o_int,
+		output	reg	[31:0]	o_occupancy
 		// }}}
 	);
 
 	// Protocol normalization
 	// {{{
-	wire			clk, reset, bus_write, read_stall;
+	wire			clk, reset, bus_write;
 	wire	[AW-1:0]	bus_read_addr;
 	reg				pre_ack;
 	// }}}
@@ -234,9 +255,8 @@ module	histogram #(
 		rvalid <= 1'b0;
 
 	assign	S_AXI_RVALID = rvalid;
-	assign	read_stall = i_ce && !resetpipe;
 	assign	axil_read_ready = !pre_ack && (!S_AXI_RVALID || S_AXI_RREADY)
-				&& !read_stall && skd_arvalid;
+				&& skd_arvalid;
 	assign	bus_read_addr = skd_araddr[AW+ADDRLSB-1:ADDRLSB];
 	// }}}
 
@@ -247,21 +267,28 @@ module	histogram #(
 	assign	reset = i_reset;
 	assign	bus_write = i_wb_stb && i_wb_we;
 	assign	bus_read_addr = i_wb_addr;
-
-	assign	read_stall = i_ce && !resetpipe;
 	// }}}
 `endif
 
 	// Register wire declarations
 	// {{{
 	reg	[ACCW-1:0]		count;
-	reg	[ACCW-1:0]		mem	[0:MEMSZ-1];
-	reg				start_reset, resetpipe, activemem,
+	reg	[ACCW-1:0]		mem0	[0:MEMSZ-1];
+	reg	[ACCW-1:0]		mem1	[0:MEMSZ-1];
+	reg	[ACCW-1:0]		mem2	[0:MEMSZ-1];
+	reg				start_reset, resetpipe,
 					first_reset_clock;
+	reg	[1:0]			activemem, idlemem, clearmem, busmem;
+	reg	[AW:0]			clraddr;
 	reg	[3:0]			cepipe;
-	reg	[ACCW-1:0]		memval, memnew, bypass_data;
-	reg	[AW:0]			r_sample, memaddr, bypass_addr;
-	reg	[AW:0]			read_addr;
+	reg	[ACCW-1:0]		mem0val, mem1val, mem2val;
+	reg	[ACCW-1:0]		memval, bus_data;
+	reg	[ACCW-1:0]		memnew, bypass_data;
+	reg	[AW+1:0]		r_sample, memaddr, bypass_addr;
+	reg	[AW+1:0]		read_addr;
+	reg	[AW-1:0]		bus_addr;
+	wire				window_end;
+	reg	[31:0]			occ0, occ1, occ2;
 	// }}}
 
 	//
@@ -271,7 +298,11 @@ module	histogram #(
 	integer	ik;
 	initial	begin
 		for(ik=0; ik<MEMSZ; ik=ik+1)
-			mem[ik] = 0;
+		begin
+			mem0[ik] = 0;
+			mem1[ik] = 0;
+			mem2[ik] = 0;
+		end
 	end
 `endif
 	// }}}
@@ -295,21 +326,19 @@ module	histogram #(
 	//
 	// Control when we start our reset cycle.
 	// {{{
-	// There are three possible reasons to start the reset cycle:
-	//   1) Based upon an external reset, i_reset,
-	//   2) Based upon writing the last sample in our average set, and
-	//   3) User commanded.
+	// There are two possible reasons to start the reset cycle:
+	//   1) Based upon an external reset, i_reset, and
+	//   2) User commanded.
 	//
-	// On the second cause only we switch memories.
+	// Either way, the reset cycle clears all three memories.  Finishing an
+	// average doesn't need a reset cycle, since the memory that will next
+	// become active is cleared in the background (below).
 	//
 	initial	start_reset = 1;
 	always @(posedge clk)
 	begin
 		start_reset <= 0;
 
-		if (cepipe[0] && (count == NAVGS[ACCW-1:0]-1))
-			start_reset <= 1;
-
 		if (bus_write)
 			start_reset <= 1;
 
@@ -330,22 +359,56 @@ module	histogram #(
 		resetpipe <= 0;
 	// }}}
 
-	// activemem, o_int: select between one of two memories to record into
+	assign	window_end = cepipe[0] && !start_reset
+				&& count == NAVGS[ACCW-1:0] -1;
+
+	// activemem, o_int: select between one of three memories
 	// {{{
+	// The memories rotate on every swap: the cleared memory becomes
+	// active, the active memory becomes idle (readable), and the idle
+	// memory is handed off to be cleared.  Since activemem only ever
+	// counts 0, 1, 2, the idle memory is always the one before it and the
+	// memory being cleared the one after it.
+	//
 	initial	activemem = 0;
 	initial	o_int = 0;
 	always @(posedge clk)
 	begin
 		o_int <= 0;
-		if (cepipe[0] && !start_reset && count == NAVGS[ACCW-1:0] -1)
+		if (window_end)
 		begin
-			activemem <= !activemem;
+			activemem <= (activemem == 2'd2) ? 2'd0 : activemem + 1;
 			o_int <= 1;
 		end
 
 		if (reset)
 			o_int <= 0;
 	end
+
+	always @(*)
+	case(activemem)
+	2'd0: begin idlemem = 2'd2; clearmem = 2'd1; end
+	2'd1: begin idlemem = 2'd0; clearmem = 2'd2; end
+	default: begin idlemem = 2'd1; clearmem = 2'd0; end
+	endcase
+	// }}}
+
+	// clraddr: Clear the memory that will next become active
+	// {{{
+	// One bin is cleared on every clock, starting from each swap, and
+	// clraddr[AW] is set once every bin has been cleared.  A window lasts
+	// at least NAVGS clocks, so the clear finishes before the next swap
+	// so long as NAVGS >= (1<<AW).  The reset cycle clears all of the
+	// memories itself, so there's nothing left to clear afterwards.
+	//
+	initial	clraddr = 0;
+	always @(posedge clk)
+	if (start_reset || resetpipe)
+		clraddr <= { 1'b1, {(AW){1'b0}} };
+	else if (window_end)
+		clraddr <= 0;
+	else if (!clraddr[AW])
+		clraddr <= clraddr + 1;
 	// }}}
 
 	// cepipe: Track i_ce through our three clocks of operations.
@@ -363,23 +426,57 @@ module	histogram #(
 	// }}}
 
 	//
-	// Cycle one: Read from memory on an input sample, from bus otherwise
+	// Cycle one: Register the sample, and separately the bus, address
 	// {{{
 	always @(posedge clk)
-	if (read_stall)
 		read_addr <= { activemem, i_sample };
-	else
-		read_addr <= { !activemem, bus_read_addr };
+
+	always @(posedge clk)
+		bus_addr <= bus_read_addr;
 	// }}}
 
 	//
 	// Cycle two: Read from memory, keep track of the address
 	// {{{
+	// The active memory is read at the sample address, the others at
+	// the bus address.
+	always @(posedge clk)
+	if (read_addr[AW+1:AW] == 2'd0)
+		mem0val <= mem0[read_addr[AW-1:0]];
+	else
+		mem0val <= mem0[bus_addr];
+
 	always @(posedge clk)
-		memval <= mem[read_addr];
+	if (read_addr[AW+1:AW] == 2'd1)
+		mem1val <= mem1[read_addr[AW-1:0]];
+	else
+		mem1val <= mem1[bus_addr];
+
+	always @(posedge clk)
+	if (read_addr[AW+1:AW] == 2'd2)
+		mem2val <= mem2[read_addr[AW-1:0]];
+	else
+		mem2val <= mem2[bus_addr];
 
 	always @(posedge clk)
 		r_sample <= read_addr;
+
+	always @(posedge clk)
+		busmem <= idlemem;
+
+	always @(*)
+	case(r_sample[AW+1:AW])
+	2'd0: memval = mem0val;
+	2'd1: memval = mem1val;
+	default: memval = mem2val;
+	endcase
+
+	always @(*)
+	case(busmem)
+	2'd0: bus_data = mem0val;
+	2'd1: bus_data = mem1val;
+	default: bus_data = mem2val;
+	endcase
 	// }}}
 	//
 	// Cycle two:
@@ -398,7 +495,6 @@ module	histogram #(
 		memaddr <= memaddr + 1;
 		if (first_reset_clock)
 			memaddr <= 0;
-		memaddr[AW] <= activemem;
 	end else begin
 		memaddr <= r_sample;
 
@@ -421,9 +517,64 @@ module	histogram #(
 	//
 	// Clock three: Write to memory
 	// {{{
+	// The reset cycle writes (zeros) to all three memories at once.
+	// Otherwise, the memory being cleared is never the one being counted
+	// into, so the two never compete for a write port.
+	always @(posedge clk)
+	if (cepipe[2] && (resetpipe || memaddr[AW+1:AW] == 2'd0))
+		mem0[memaddr[AW-1:0]] <= memnew;
+	else if (!clraddr[AW] && clearmem == 2'd0)
+		mem0[clraddr[AW-1:0]] <= 0;
+
+	always @(posedge clk)
+	if (cepipe[2] && (resetpipe || memaddr[AW+1:AW] == 2'd1))
+		mem1[memaddr[AW-1:0]] <= memnew;
+	else if (!clraddr[AW] && clearmem == 2'd1)
+		mem1[clraddr[AW-1:0]] <= 0;
+
+	always @(posedge clk)
+	if (cepipe[2] && (resetpipe || memaddr[AW+1:AW] == 2'd2))
+		mem2[memaddr[AW-1:0]] <= memnew;
+	else if (!clraddr[AW] && clearmem == 2'd2)
+		mem2[clraddr[AW-1:0]] <= 0;
+	// }}}
+
+	//
+	// occ0, occ1, o_occupancy: Which blocks of each memory hold counts
+	// {{{
+	// Set a block's bit on any non-zero write into it.  (The reset pass
+	// and the background clear only ever write zeros.)  Clear a memory's
+	// map whenever that memory is handed off to be cleared.
+	//
+	initial	occ0 = 0;
+	always @(posedge clk)
+	if (resetpipe || (window_end && idlemem == 2'd0))
+		occ0 <= 0;
+	else if (cepipe[2] && memaddr[AW+1:AW] == 2'd0 && memnew != 0)
+		occ0[memaddr[AW-1:AW-5]] <= 1'b1;
+
+	initial	occ1 = 0;
+	always @(posedge clk)
+	if (resetpipe || (window_end && idlemem == 2'd1))
+		occ1 <= 0;
+	else if (cepipe[2] && memaddr[AW+1:AW] == 2'd1 && memnew != 0)
+		occ1[memaddr[AW-1:AW-5]] <= 1'b1;
+
+	initial	occ2 = 0;
 	always @(posedge clk)
-	if (cepipe[2])
-		mem[memaddr] <= memnew;
+	if (resetpipe || (window_end && idlemem == 2'd2))
+		occ2 <= 0;
+	else if (cepipe[2] && memaddr[AW+1:AW] == 2'd2 && memnew != 0)
+		occ2[memaddr[AW-1:AW-5]] <= 1'b1;
+
+	// The bus gets the map of the idle memory
+	initial	o_occupancy = 0;
+	always @(posedge clk)
+	case(idlemem)
+	2'd0: o_occupancy <= occ0;
+	2'd1: o_occupancy <= occ1;
+	default: o_occupancy <= occ2;
+	endcase
 	// }}}
 
 	//
@@ -450,7 +601,7 @@ module	histogram #(
 	if (pre_ack)
 	begin
 		S_AXI_RDATA <= 0;
-		S_AXI_RDATA[ACCW-1:0] <= memval;
+		S_AXI_RDATA[ACCW-1:0] <= bus_data;
 	end
 
 	assign S_AXI_RRESP = 2'b00;
@@ -460,7 +611,7 @@ module	histogram #(
 	always @(*)
 	begin
 		o_wb_data = 0;
-		o_wb_data[ACCW-1:0] = memval; // mem[{ !activemem, i_wb_addr }];
+		o_wb_data[ACCW-1:0] = bus_data; // mem[{ idlemem, i_wb_addr }];
 	end
 
 	initial { o_wb_ack, pre_ack } = 0;
@@ -470,7 +621,7 @@ module	histogram #(
 		o_wb_ack <= !reset && i_wb_cyc && pre_ack;
 
 	always @(*)
-		o_wb_stall = read_stall;
+		o_wb_stall = 1'b0;
 	// }}}
 `endif
 	// }}}
@@ -494,9 +645,10 @@ module	histogram #(
 `ifdef	FORMAL
 	// Declarations, and f_past_valid
 	// {{{
-	(* anyconst *)	reg [AW:0]	f_addr;
+	(* anyconst *)	reg [AW+1:0]	f_addr;
 			reg [ACCW-1:0]	f_mem_data, f_this_counts;
 	reg	[3:0]	f_this_pipe;
+	wire		f_cleared;
 
 	reg	f_past_valid;
 	initial	f_past_valid = 0;
@@ -504,11 +656,22 @@ module	histogram #(
 		f_past_valid <= 1;
 
 	always @(*)
-		f_mem_data = mem[f_addr];
+		assume(f_addr[AW+1:AW] != 2'b11);
+
+	always @(*)
+	case(f_addr[AW+1:AW])
+	2'd0: f_mem_data = mem0[f_addr[AW-1:0]];
+	2'd1: f_mem_data = mem1[f_addr[AW-1:0]];
+	default: f_mem_data = mem2[f_addr[AW-1:0]];
+	endcase
+
+	// True if the background clear has already passed our special value
+	assign	f_cleared = clearmem == f_addr[AW+1:AW]
+			&& (clraddr[AW] || clraddr[AW-1:0] > f_addr[AW-1:0]);
 
 	always @(*)
 	if (!f_past_valid)
-		assume(mem[f_addr] == 0);
+		assume(f_mem_data == 0);
 	// }}}
 	////////////////////////////////////////////////////////////////////////
 	//
@@ -555,10 +718,13 @@ module	histogram #(
 	if (start_reset || resetpipe)
 	begin
 		// Clear our special value on or during any reset
-		if (activemem == f_addr[AW])
-			f_this_counts <= 0;
+		f_this_counts <= 0;
 
-	end else if (f_this_pipe[0]) // ($past(i_ce && { activemem, i_sample } == f_addr))
+	end else if (!clraddr[AW] && clearmem == f_addr[AW+1:AW]
+			&& clraddr[AW-1:0] == f_addr[AW-1:0])
+		// The background clear is zeroing our value's memory
+		f_this_counts <= 0;
+	else if (f_this_pipe[0]) // ($past(i_ce && { activemem, i_sample } == f_addr))
 		// In all other cases, if we see our special value,
 		// accumulate  it
 		f_this_counts <= f_this_counts + 1;
@@ -572,7 +738,7 @@ module	histogram #(
 	always @(posedge clk)
 	begin
 		f_this_pipe <= { f_this_pipe[2:0], (!start_reset && i_ce
-				&& activemem == f_addr[AW]
+				&& activemem == f_addr[AW+1:AW]
 				&& i_sample == f_addr[AW-1:0]) };
 
 		if (resetpipe)
@@ -587,7 +753,7 @@ module	histogram #(
 		assert(f_this_pipe[3:1] == 0);
 
 	always @(*)
-	if (resetpipe && activemem == f_addr[AW])
+	if (resetpipe)
 	begin
 		assert(first_reset_clock || f_this_counts == 0);
 	end else if (f_this_pipe[2:1] == 0)
@@ -621,14 +787,12 @@ module	histogram #(
 	// {{{
 	always @(posedge clk)
 	if (f_past_valid && $past(f_past_valid) && cepipe[2]
-			&& { activemem, memaddr } == f_addr
+			&& memaddr == f_addr
 			&& !resetpipe)
 		assert(f_mem_data == $past(f_this_counts,2));
 
 	always @(*)
-	if (resetpipe && !first_reset_clock
-			&& activemem == f_addr[AW]
-			&& memaddr[AW-1:0] > f_addr[AW-1:0])
+	if (resetpipe && !first_reset_clock && memaddr > f_addr)
 		assert(f_mem_data == 0);
 	// }}}
 
@@ -640,6 +804,50 @@ module	histogram #(
 	if (!resetpipe)
 		assert((f_this_pipe & cepipe) == f_this_pipe);
 
+	//
+	// Any counts in our special value must be reflected in the occupancy
+	// map for its memory--unless that memory is being cleared, since its
+	// map is cleared at the start of the clear.
+	//
+	always @(*)
+	if (!resetpipe && f_mem_data != 0
+			&& clearmem != f_addr[AW+1:AW])
+	case(f_addr[AW+1:AW])
+	2'd0: assert(occ0[f_addr[AW-1:AW-5]]);
+	2'd1: assert(occ1[f_addr[AW-1:AW-5]]);
+	default: assert(occ2[f_addr[AW-1:AW-5]]);
+	endcase
+
+	////////////////////////////////////////////////////////////////////////
+	//
+	// Background clear checks
+	// {{{
+	////////////////////////////////////////////////////////////////////////
+	//
+	//
+	always @(*)
+		assert(activemem != 2'b11);
+
+	// Once the clear has passed our value, it must stay clear, since
+	// nothing else writes to the memory being cleared
+	always @(*)
+	if (!resetpipe && f_cleared)
+	begin
+		assert(f_mem_data == 0);
+		assert(f_this_counts == 0);
+	end
+
+	// The clear runs one bin per clock, while the count can grow by at
+	// most one per clock.  As long as NAVGS >= (1<<AW), the clear must
+	// therefore finish before the memory being cleared becomes active.
+	generate if (NAVGS >= (1<<AW))
+	begin : CHECK_CLEAR_DONE
+		always @(*)
+		if (!resetpipe && !clraddr[AW])
+			assert(clraddr[AW-1:0] >= count);
+	end endgenerate
+	// }}}
+
 	////////////////////////////////////////////////////////////////////////
 	//
 	// The counter is not allowed to overflow
@@ -661,7 +869,7 @@ module	histogram #(
 		assert(f_this_counts <= NAVGS);
 
 	always @(*)
-	if (!start_reset && !resetpipe && activemem == f_addr[AW])
+	if (!start_reset && !resetpipe && activemem == f_addr[AW+1:AW])
 		assert(f_this_counts <= count);
 
 	// }}}
@@ -687,7 +895,7 @@ module	histogram #(
 	begin
 		assert(o_int);
 		assert($changed(activemem));
-		assert(start_reset);
+		assert(clraddr == 0);
 		assert(count == 0);
 	end
 
@@ -701,17 +909,16 @@ module	histogram #(
 	assert property (@(posedge clk)
 		start_reset
 		|=> first_reset_clock && resetpipe
-		##1 resetpipe && memaddr[AW-1:0] == 0
-			&& memaddr[AW] == activemem);
+		##1 resetpipe && memaddr == 0);
 
 	assert property (@(posedge clk)
-		i_ce && (i_sample == { activemem, f_addr})
+		i_ce && ({ activemem, i_sample } == f_addr)
 				&& !start_reset && !resetpipe
 		##1 !start_reset && !resetpipe
 		|=> ##2 f_mem_data == $past(f_mem_data + 1));
 
 	assert property (@(posedge clk)
-		$fell(resetpipe) && activemem == f_addr[AW]
+		$fell(resetpipe)
 		|=> f_mem_data == 0);
 
 	assert property (@(posedge clk)
@@ -721,7 +928,7 @@ module	histogram #(
 	assert property (@(posedge clk)
 		!reset && !start_reset && cepipe[0] && !bus_write
 		&& count == NAVGS-1
-		|=> o_int && start_reset && count == 0);
+		|=> o_int && count == 0);
 `endif
 
 	always @(*)
@@ -778,21 +985,21 @@ module	histogram #(
 
 		cover property (@(posedge clk)
 			i_wb_stb && !o_wb_stall && !i_wb_we
-			&& (i_wb_addr == f_addr[AW-1:0]) // && activemem
-				&& f_addr[AW] == !activemem);
+			&& (i_wb_addr == f_addr[AW-1:0])
+				&& f_addr[AW+1:AW] == idlemem);
 
 		cover property (@(posedge clk)
 			i_wb_stb && !o_wb_stall
-			&& (i_wb_addr == f_addr[AW-1:0]) && activemem
-				&& f_addr[AW] == !activemem
+			&& (i_wb_addr == f_addr[AW-1:0])
+				&& f_addr[AW+1:AW] == idlemem
 			##1 i_wb_cyc && pre_ack
 			##2 o_wb_ack && o_wb_data[ACCW-1:0] == f_mem_data
 				&& f_mem_data == 0);
 
 		cover property (@(posedge clk)
 			i_wb_stb && !o_wb_stall
-			&& (i_wb_addr == f_addr[AW-1:0]) && activemem
-				&& f_addr[AW] == !activemem
+			&& (i_wb_addr == f_addr[AW-1:0])
+				&& f_addr[AW+1:AW] == idlemem
 			##2 o_wb_ack && o_wb_data[ACCW-1:0] == f_mem_data
 				&& f_mem_data == NAVGS);
 `endif
@@ -9,7 +9,7 @@
 // Computer Generated: This file is computer generated by AUTOFPGA. DO NOT EDIT.
 // DO NOT EDIT THIS FILE!
 //
-// CmdLine:	autofpga autofpga -d -o . global.txt clock36.txt version.txt hexbus.txt gpio.txt qpsksim.txt histogram.txt rfscope.txt samplerate.txt
+// CmdLine:	autofpga autofpga -d -o . global.txt clock36.txt version.txt hexbus.txt gpio.txt i2ccmd.txt qpsksim.txt histogram.txt rfscope.txt samplerate.txt
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -57,6 +57,7 @@
 // And then for the independent peripherals
 `define	RFSCOPE_ACCESS
 `define	GPIO_ACCESS
+`define	I2CCMD_ACCESS
 //
 // End of dependency list
 //
@@ -80,6 +81,8 @@ module	main(i_clk, i_reset,
 		o_pwm_audio, o_pwm_shutdown_n, o_pwm_gain,
 		// GPIO ports
 		i_gpio, o_gpio,
+		// I2C master
+		o_i2c_scl, o_i2c_sda,
  		// UART/host to wishbone interface
  		i_host_uart_rx, o_host_uart_tx);
 //
@@ -108,6 +111,8 @@ module	main(i_clk, i_reset,
 	// GPIO ports
 	input		[(NGPI-1):0]	i_gpio;
 	output	wire	[(NGPO-1):0]	o_gpio;
+	// I2CCMD ports
+	output	wire		o_i2c_scl, o_i2c_sda;
 	input	wire		i_host_uart_rx;
 	output	wire		o_host_uart_tx;
 	// Make Verilator happy ... defining bus wires for lots of components
@@ -124,6 +129,7 @@ module	main(i_clk, i_reset,
 	// given under the @INT.<interrupt name>.WIRE key.
 	//
 	wire	gpio_int;	// gpio.INT.GPIO.WIRE
+	wire	i2c_int;	// i2c.INT.I2C.WIRE
 
 
 	//
@@ -169,6 +175,7 @@ module	main(i_clk, i_reset,
 	reg		r_samplerate_restart;
 
 	wire	hist_int;
+	wire	[31:0]	hist_occupancy;
 `include "builddate.v"
 // BUILDTIME doesnt need to include builddate.v a second time
 // `include "builddate.v"
@@ -232,6 +239,15 @@ module	main(i_clk, i_reset,
 	wire		wb_version_stall, wb_version_ack, wb_version_err;
 	wire	[31:0]	wb_version_idata;
 	// Verilator lint_on UNUSED
+	// Wishbone definitions for bus wb(SIO), component histocc
+	// Verilator lint_off UNUSED
+	wire		wb_histocc_cyc, wb_histocc_stb, wb_histocc_we;
+	wire	[10:0]	wb_histocc_addr;
+	wire	[31:0]	wb_histocc_data;
+	wire	[3:0]	wb_histocc_sel;
+	wire		wb_histocc_stall, wb_histocc_ack, wb_histocc_err;
+	wire	[31:0]	wb_histocc_idata;
+	// Verilator lint_on UNUSED
 	// Wishbone definitions for bus wb, component rfscope
 	// Verilator lint_off UNUSED
 	wire		wb_rfscope_cyc, wb_rfscope_stb, wb_rfscope_we;
@@ -241,6 +257,15 @@ module	main(i_clk, i_reset,
 	wire		wb_rfscope_stall, wb_rfscope_ack, wb_rfscope_err;
 	wire	[31:0]	wb_rfscope_idata;
 	// Verilator lint_on UNUSED
+	// Wishbone definitions for bus wb(SIO), component i2c
+	// Verilator lint_off UNUSED
+	wire		wb_i2c_cyc, wb_i2c_stb, wb_i2c_we;
+	wire	[10:0]	wb_i2c_addr;
+	wire	[31:0]	wb_i2c_data;
+	wire	[3:0]	wb_i2c_sel;
+	wire		wb_i2c_stall, wb_i2c_ack, wb_i2c_err;
+	wire	[31:0]	wb_i2c_idata;
+	// Verilator lint_on UNUSED
 	// Wishbone definitions for bus wb, component wb_sio
 	// Verilator lint_off UNUSED
 	wire		wb_sio_cyc, wb_sio_stb, wb_sio_we;
@@ -289,12 +314,13 @@ module	main(i_clk, i_reset,
 	assign	wb_sio_ack = r_wb_sio_ack;
 
 	always	@(posedge i_clk)
-	casez( wb_sio_addr[1:0] )
-	2'h0: r_wb_sio_data <= wb_buildtime_idata;
-	2'h1: r_wb_sio_data <= wb_gpio_idata;
-	2'h2: r_wb_sio_data <= wb_samplerate_idata;
-	2'h3: r_wb_sio_data <= wb_version_idata;
-	// No default: SIZE = 4, [Guru meditation: 2 != 2]
+	casez( wb_sio_addr[2:0] )
+	3'h0: r_wb_sio_data <= wb_buildtime_idata;
+	3'h1: r_wb_sio_data <= wb_gpio_idata;
+	3'h2: r_wb_sio_data <= wb_samplerate_idata;
+	3'h3: r_wb_sio_data <= wb_version_idata;
+	3'h4: r_wb_sio_data <= wb_histocc_idata;
+	default: r_wb_sio_data <= wb_i2c_idata;
 	endcase
 	assign	wb_sio_idata = r_wb_sio_data;
 
@@ -308,25 +334,35 @@ module	main(i_clk, i_reset,
 	// Our goal here is to make certain that all of
 	// the slave bus inputs match the SIO bus wires
 	assign	wb_buildtime_cyc = wb_sio_cyc;
-	assign	wb_buildtime_stb = wb_sio_stb && (wb_sio_addr[ 1: 0] ==  2'h0);  // 0x000
+	assign	wb_buildtime_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h0);  // 0x000
 	assign	wb_buildtime_we  = wb_sio_we;
 	assign	wb_buildtime_data= wb_sio_data;
 	assign	wb_buildtime_sel = wb_sio_sel;
 	assign	wb_gpio_cyc = wb_sio_cyc;
-	assign	wb_gpio_stb = wb_sio_stb && (wb_sio_addr[ 1: 0] ==  2'h1);  // 0x004
+	assign	wb_gpio_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h1);  // 0x004
 	assign	wb_gpio_we  = wb_sio_we;
 	assign	wb_gpio_data= wb_sio_data;
 	assign	wb_gpio_sel = wb_sio_sel;
 	assign	wb_samplerate_cyc = wb_sio_cyc;
-	assign	wb_samplerate_stb = wb_sio_stb && (wb_sio_addr[ 1: 0] ==  2'h2);  // 0x008
+	assign	wb_samplerate_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h2);  // 0x008
 	assign	wb_samplerate_we  = wb_sio_we;
 	assign	wb_samplerate_data= wb_sio_data;
 	assign	wb_samplerate_sel = wb_sio_sel;
 	assign	wb_version_cyc = wb_sio_cyc;
-	assign	wb_version_stb = wb_sio_stb && (wb_sio_addr[ 1: 0] ==  2'h3);  // 0x00c
+	assign	wb_version_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h3);  // 0x00c
 	assign	wb_version_we  = wb_sio_we;
 	assign	wb_version_data= wb_sio_data;
 	assign	wb_version_sel = wb_sio_sel;
+	assign	wb_histocc_cyc = wb_sio_cyc;
+	assign	wb_histocc_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h4);  // 0x010
+	assign	wb_histocc_we  = wb_sio_we;
+	assign	wb_histocc_data= wb_sio_data;
+	assign	wb_histocc_sel = wb_sio_sel;
+	assign	wb_i2c_cyc = wb_sio_cyc;
+	assign	wb_i2c_stb = wb_sio_stb && (wb_sio_addr[ 2: 0] ==  3'h5);  // 0x014
+	assign	wb_i2c_we  = wb_sio_we;
+	assign	wb_i2c_data= wb_sio_data;
+	assign	wb_i2c_sel = wb_sio_sel;
 	//
 	// No class DOUBLE peripherals on the "wb" bus
 	//
@@ -582,6 +618,25 @@ module	main(i_clk, i_reset,
 	assign	gpio_int = 1'b0;	// gpio.INT.GPIO.WIRE
 `endif	// GPIO_ACCESS
 
+`ifdef	I2CCMD_ACCESS
+	//
+	// I2CCMD
+	//
+	// The pins are read back through the GPIO inputs: i_gpio[0] is SCL,
+	// and i_gpio[1] is SDA
+	wbi2ccmd #(.CLKDIV(36000000 / 400000), .LGFIFO(5))
+	i2ci(i_clk, i_reset, wb_i2c_cyc, wb_i2c_stb, wb_i2c_we,
+			wb_i2c_data, // 32 bits wide
+			wb_i2c_sel,  // 32/8 bits wide
+		wb_i2c_stall, wb_i2c_ack, wb_i2c_idata,
+		i_gpio[0], i_gpio[1],
+		o_i2c_scl, o_i2c_sda, i2c_int);
+`else	// I2CCMD_ACCESS
+	assign	o_i2c_scl = 1'b1;
+	assign	o_i2c_sda = 1'b1;
+	assign	i2c_int = 1'b0;	// i2c.INT.I2C.WIRE
+`endif	// I2CCMD_ACCESS
+
 `ifdef	HEXBUS_MASTER
 	// The Host USB interface, to be used by the WB-UART bus
 	rxuartlite	#(.TIMER_BITS(BUSUARTBITS[4:0]),
@@ -599,7 +654,7 @@ module	main(i_clk, i_reset,
 			wb_hex_data, // 32 bits wide
 			wb_hex_sel,  // 32/8 bits wide
 		wb_hex_stall, wb_hex_ack, wb_hex_idata,wb_hex_err,
-		1'b0,	// No interrupts defined
+		hist_int,	// Histogram frame completion interrupt
 		tx_host_stb, tx_host_data, tx_host_busy);
 `else	// HEXBUS_MASTER
 `endif	// HEXBUS_MASTER
@@ -653,7 +708,11 @@ module	main(i_clk, i_reset,
 			wb_hist_sel,  // 32/8 bits wide
 		wb_hist_stall, wb_hist_ack, wb_hist_idata,
 		rfdbg_ce, rfdbg_hist,
-		hist_int);
+		hist_int, hist_occupancy);
+
+	assign	wb_histocc_stall = 1'b0;
+	assign	wb_histocc_ack   = wb_histocc_stb;
+	assign	wb_histocc_idata = hist_occupancy;
 	assign	wb_version_idata = `DATESTAMP;
 	assign	wb_version_ack = wb_version_stb;
 	assign	wb_version_stall = 1'b0;
@@ -8,7 +8,7 @@
 // Computer Generated: This file is computer generated by AUTOFPGA. DO NOT EDIT.
 // DO NOT EDIT THIS FILE!
 //
-// CmdLine:	autofpga autofpga -d -o . global.txt clock36.txt version.txt hexbus.txt gpio.txt qpsksim.txt histogram.txt rfscope.txt samplerate.txt
+// CmdLine:	autofpga autofpga -d -o . global.txt clock36.txt version.txt hexbus.txt gpio.txt i2ccmd.txt qpsksim.txt histogram.txt rfscope.txt samplerate.txt
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -102,6 +102,7 @@ module	toplevel(i_clk_12mhz,
 	wire	[6 -1:0]	i_gpio;
 	wire	[9-1:0]	o_gpio;
 	wire				i_i2c_sda, i_i2c_scl;
+	wire		o_i2c_scl, o_i2c_sda;
 	wire		s_clk, s_reset, pll_locked;
 	reg	[2:0]	reset_pipe;
 	reg	[9:0]	rst_counter;
@@ -129,6 +130,8 @@ module	toplevel(i_clk_12mhz,
 		o_pwm_audio, o_pwm_shutdown_n, o_pwm_gain,
 		// GPIO wires
 		i_gpio, o_gpio,
+		// I2C master
+		o_i2c_scl, o_i2c_sda,
  		// UART/host to wishbone interface
  		i_host_uart_rx, o_host_uart_tx);
 
@@ -144,12 +147,15 @@ module	toplevel(i_clk_12mhz,
 	assign	o_ledg = !o_gpio[2];
 	assign	o_ledr = !o_gpio[3] || !pll_locked;
 
-	i2cio sckz(o_gpio[0], i_i2c_scl, io_i2c_scl);
-	i2cio sdaz(o_gpio[1], i_i2c_sda, io_i2c_sda);
+	// The I2C pins themselves are shared with the I2C master, i2ccmd.txt
 
 	oclkddr
 	rfclock(s_clk, { o_gpio[4], 1'b0 }, o_rf_clk);
 	
+	// The I2C pins are open drain, shared between the GPIO outputs and
+	// the I2C master
+	i2cio sckz(o_gpio[0] && o_i2c_scl, i_i2c_scl, io_i2c_scl);
+	i2cio sdaz(o_gpio[1] && o_i2c_sda, i_i2c_sda, io_i2c_sda);
 
 	// No resets?
 	// assign	s_reset = 1'b0;
@@ -0,0 +1,292 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	wbi2ccmd.v
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	A small I2C master, driven by a FIFO of byte level commands.
+//
+//	Bit-banging I2C through the GPIO register costs at least one round
+//	trip across the debugging bus per clock edge.  This core instead
+//	accepts whole transactions from the bus--start, address, data, and
+//	stop--as a burst of writes to a single register, and then plays them
+//	out on the wire at the I2C rate on its own.
+//
+// Registers:	The core has a single register.
+//
+//	Writes push a command into the command FIFO.  Bits [10:8] hold the
+//	command, and bits [7:0] any data byte that goes with it:
+//
+//	0: Clear the NACK and overflow flags, and discard any bytes read
+//	   but not yet collected.  (Doesn't enter the FIFO.)
+//	1: (Repeated) start condition
+//	2: Stop condition
+//	3: Write the byte in bits [7:0], recording whether it was ACKed
+//	4: Read a byte, and acknowledge it
+//	5: Read a byte without acknowledging it, as for the last byte of a read
+//
+//	Reads return the core's status, and pop one byte from the FIFO of
+//	bytes read (if there is one):
+//
+//	31:	Busy.  Commands remain to be executed.
+//	30:	NACK.  A written byte wasn't acknowledged since the last clear.
+//	29:	Overflow.  A command was written while the FIFO was full, and
+//		so lost, since the last clear.
+//	LGFIFO+16:16	The number of commands waiting within the FIFO
+//	8:	Valid.  Bits [7:0] hold a byte that was read from the wire.
+//	7:0:	The byte read, if valid
+//
+//	o_int strobes once the core runs out of commands to execute.
+//
+//	SCL and SDA are open drain, so o_scl and o_sda should be ANDed with any
+//	other drivers of the same pins.  The slave may stretch the clock: the
+//	core waits for SCL to be released before continuing.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+`default_nettype	none
+// }}}
+module	wbi2ccmd #(
+		// {{{
+		// Clocks per quarter I2C bit period.  100kHz from a 36MHz clock
+		// requires 90.
+		parameter	CLKDIV = 90,
+		parameter	LGFIFO = 5
+		// }}}
+	) (
+		// {{{
+		input	wire		i_clk, i_reset,
+		// Wishbone interface
+		// {{{
+		input	wire		i_wb_cyc, i_wb_stb, i_wb_we,
+		input	wire	[31:0]	i_wb_data,
+		input	wire	[3:0]	i_wb_sel,
+		output	wire		o_wb_stall, o_wb_ack,
+		output	wire	[31:0]	o_wb_data,
+		// }}}
+		// I2C pins
+		// {{{
+		input	wire		i_scl, i_sda,
+		output	reg		o_scl, o_sda,
+		// }}}
+		output	reg		o_int
+		// }}}
+	);
+
+	// Declarations
+	// {{{
+	localparam	[2:0]	CMD_CLEAR = 3'h0,
+				CMD_START = 3'h1,
+				CMD_STOP  = 3'h2,
+				CMD_WRITE = 3'h3,
+				CMD_READ  = 3'h4,
+				CMD_READN = 3'h5;
+	localparam	[1:0]	SYM_DATA  = 2'b00,
+				SYM_START = 2'b01,
+				SYM_STOP  = 2'b10;
+	localparam	CW = $clog2(CLKDIV);
+	localparam [CW-1:0]	DIVLOAD = CLKDIV-1;
+
+	reg	[1:0]	x_scl, x_sda;
+	wire		scl_in, sda_in;
+
+	wire		clear, cmd_wr, cmd_rd, cmd_full, cmd_empty;
+	wire	[LGFIFO:0]	cmd_fill;
+	wire	[10:0]	cmd_data;
+
+	reg		rd_wr;
+	wire		rd_rd, rd_full, rd_empty;
+	wire	[LGFIFO:0]	rd_fill;
+	wire	[7:0]	rd_data;
+
+	reg		busy, nack, overflow;
+	reg	[2:0]	op;
+	reg	[1:0]	sym, quarter;
+	reg	[3:0]	nsym;
+	reg	[8:0]	obits, ibits;
+	reg	[CW-1:0]	divcount;
+	wire		tick, stretched, last_quarter;
+	// }}}
+
+	// Synchronize the pins
+	// {{{
+	initial	{ x_scl, x_sda } = -1;
+	always @(posedge i_clk)
+	begin
+		x_scl <= { x_scl[0], i_scl };
+		x_sda <= { x_sda[0], i_sda };
+	end
+
+	assign	scl_in = x_scl[1];
+	assign	sda_in = x_sda[1];
+	// }}}
+
+	// Command and read data FIFOs
+	// {{{
+	assign	clear  = i_wb_stb && i_wb_we && (i_wb_data[10:8] == CMD_CLEAR);
+	assign	cmd_wr = i_wb_stb && i_wb_we && !clear;
+	assign	cmd_rd = !busy && !cmd_empty;
+
+	sfifo #(.BW(11), .LGFLEN(LGFIFO))
+	cmdfifo(i_clk, i_reset, cmd_wr, i_wb_data[10:0], cmd_full, cmd_fill,
+		cmd_rd, cmd_data, cmd_empty);
+
+	assign	rd_rd = i_wb_stb && !i_wb_we;
+
+	sfifo #(.BW(8), .LGFLEN(LGFIFO))
+	rdfifo(i_clk, i_reset || clear, rd_wr, ibits[8:1], rd_full, rd_fill,
+		rd_rd, rd_data, rd_empty);
+	// }}}
+
+	// Quarter bit timing
+	// {{{
+	// The clock is stretched whenever we've released SCL, but it has yet
+	// to rise
+	assign	stretched = o_scl && !scl_in;
+	assign	tick = busy && (divcount == 0) && !stretched;
+	assign	last_quarter = tick && (quarter == 2'b11);
+
+	initial	divcount = 0;
+	always @(posedge i_clk)
+	if (i_reset || cmd_rd || tick)
+		divcount <= DIVLOAD;
+	else if (busy && divcount != 0)
+		divcount <= divcount - 1;
+
+	initial	quarter = 0;
+	always @(posedge i_clk)
+	if (i_reset || cmd_rd)
+		quarter <= 0;
+	else if (tick)
+		quarter <= quarter + 1;
+	// }}}
+
+	// Command sequencing
+	// {{{
+	// Each command is broken into symbols--a start, a stop, or a bit--of
+	// four quarter bit periods each.  A byte is nine symbols: eight data
+	// bits, and the acknowledgement.
+	initial	busy = 0;
+	initial	nsym = 0;
+	always @(posedge i_clk)
+	if (i_reset)
+	begin
+		busy <= 0;
+		nsym <= 0;
+	end else if (cmd_rd)
+	begin
+		busy <= 1;
+		op   <= cmd_data[10:8];
+		case(cmd_data[10:8])
+		CMD_START: begin sym <= SYM_START; nsym <= 1; end
+		CMD_STOP:  begin sym <= SYM_STOP;  nsym <= 1; end
+		default:   begin sym <= SYM_DATA;  nsym <= 9; end
+		endcase
+
+		case(cmd_data[10:8])
+		CMD_WRITE: obits <= { cmd_data[7:0], 1'b1 };
+		CMD_READ:  obits <= { 8'hff, 1'b0 };
+		default:   obits <= 9'h1ff;
+		endcase
+	end else if (last_quarter)
+	begin
+		obits <= { obits[7:0], 1'b1 };
+		nsym  <= nsym - 1;
+		if (nsym <= 1)
+			busy <= 0;
+	end
+
+	// Sample SDA at the end of the SCL high time
+	always @(posedge i_clk)
+	if (tick && quarter == 2'b10 && sym == SYM_DATA)
+		ibits <= { ibits[7:0], sda_in };
+
+	// Push bytes read into the read FIFO, and note any missing ACKs
+	initial	rd_wr = 0;
+	always @(posedge i_clk)
+		rd_wr <= !i_reset && last_quarter && nsym == 1
+			&& (op == CMD_READ || op == CMD_READN);
+
+	initial	nack = 0;
+	always @(posedge i_clk)
+	if (i_reset || clear)
+		nack <= 0;
+	else if (last_quarter && nsym == 1 && op == CMD_WRITE && ibits[0])
+		nack <= 1;
+
+	initial	overflow = 0;
+	always @(posedge i_clk)
+	if (i_reset || clear)
+		overflow <= 0;
+	else if (cmd_wr && cmd_full)
+		overflow <= 1;
+
+	initial	o_int = 0;
+	always @(posedge i_clk)
+		o_int <= !i_reset && last_quarter && nsym == 1 && cmd_empty;
+	// }}}
+
+	// o_scl, o_sda
+	// {{{
+	initial	{ o_scl, o_sda } = 2'b11;
+	always @(posedge i_clk)
+	if (i_reset)
+		{ o_scl, o_sda } <= 2'b11;
+	else if (busy)
+	case(sym)
+	SYM_START: begin
+		o_scl <= (quarter == 2'b01 || quarter == 2'b10);
+		o_sda <= !quarter[1];
+		end
+	SYM_STOP: begin
+		o_scl <= (quarter != 2'b00);
+		o_sda <= quarter[1];
+		end
+	default: begin
+		o_scl <= (quarter == 2'b01 || quarter == 2'b10);
+		o_sda <= obits[8];
+		end
+	endcase
+	// }}}
+
+	assign	o_wb_stall = 1'b0;
+	assign	o_wb_ack   = i_wb_stb;
+	assign	o_wb_data  = { busy || !cmd_empty, nack, overflow,
+			{(12-LGFIFO){1'b0}}, cmd_fill,
+			7'h0, !rd_empty, rd_data };
+
+	// Make Verilator happy
+	// {{{
+	// verilator lint_off UNUSED
+	wire	unused;
+	assign	unused = &{ 1'b0, i_wb_cyc, i_wb_data[31:11], i_wb_sel,
+			rd_full, rd_fill };
+	// verilator lint_on  UNUSED
+	// }}}
+endmodule
@@ -43,6 +43,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdint.h>
+#include <vector>
 
 #include "verilated.h"
 #include "design.h"
@@ -56,17 +57,92 @@
 
 #include "main_tb.cpp"
 
+// Exit codes
+// {{{
+// EXIT_SUCCESS (0) once the run completes, and EXIT_FAILURE (1) on any
+// error in the arguments.  Should the simulation itself fail, as judged by a
+// failure expression (-x) or a simulation component, the exit code is
+// EXIT_SIMFAIL.  A run stopped by SIGINT or SIGTERM while gathering
+// statistics exits with EXIT_STOPPED.
+#define	EXIT_SIMFAIL	2
+#define	EXIT_STOPPED	3
+// }}}
+
+// The main loop checks for signals every RUN_CHUNK ticks
+#define	RUN_CHUNK	4096
+
+volatile sig_atomic_t	m_stop = 0;
+
+void	stopsim(int v) {
+	m_stop = v;
+}
+
+// parseticks()
+// {{{
+// Parse a run length: either a number of ticks, or a simulated time with an
+// s, ms, us, or ns suffix.  Returns zero on any error.
+uint64_t	parseticks(const char *str) {
+	char	*ptr;
+	double	v = strtod(str, &ptr), ps;
+
+	if (ptr == str || v < 0.0)
+		return 0;
+	if (*ptr == '\0')
+		return (uint64_t)v;
+	else if (strcmp(ptr, "s") == 0)
+		ps = v * 1e12;
+	else if (strcmp(ptr, "ms") == 0)
+		ps = v * 1e9;
+	else if (strcmp(ptr, "us") == 0)
+		ps = v * 1e6;
+	else if (strcmp(ptr, "ns") == 0)
+		ps = v * 1e3;
+	else
+		return 0;
+	return (uint64_t)(ps / TESTB_PERIOD_PS + 0.5);
+}
+// }}}
+
 // usage()
 // {{{
 void	usage(void) {
 	fprintf(stderr, "USAGE: main_tb <options>\n");
 	fprintf(stderr,
 // -h
-// -p # command port
-// -s # serial port
 // -f # profile file
-"\t-d\tSets the debugging flag\n"
-);
+"\t-d\tSets the debugging flag, and traces to trace.vcd\n"
+"\t-t file\tTraces to the given file\n"
+"\t-w start[:stop]\tOnly traces from tick number start to tick stop\n"
+"\t-e expr\tDon't start tracing until the trigger expression, expr, is\n"
+"\t\ttrue.  Use -e ? for the list of probes expr may use.\n"
+"\t-l ticks\tStop tracing after this many ticks\n"
+"\t-v depth\tOnly trace this many levels of the design's hierarchy\n"
+"\t-m scope\tOnly trace beneath this scope, as in TOP.main.u_rcvr\n"
+"\t-r ticks\tKeep the last ticks of the probes in a flight recorder, to\n"
+"\t\tbe written to flight.vcd should the simulation fail or be\n"
+"\t\tinterrupted\n"
+"\t-g probes\tRecord only these probes (comma separated), rather than\n"
+"\t\tall of them\n"
+"\t-x expr\tTreat the simulation as failed once expr is true\n"
+"\t-o file\tWrite the flight recorder to file, rather than flight.vcd\n"
+"\t-n len\tRun for len ticks, or (given an s, ms, us, or ns suffix) for\n"
+"\t\tlen of simulated time, and then exit.  The run stops early\n"
+"\t\tshould the simulation fail.\n"
+"\t-k file\tSave a checkpoint of the simulation to file once done\n"
+"\t-c file\tContinue the simulation from a checkpoint saved with -k,\n"
+"\t\trather than starting from reset.  Any -n length then counts\n"
+"\t\tfrom the checkpoint.  (Both need a model built with SAVE=1)\n"
+"\t-p port\tListen for the debug bus on this TCP port, rather than %d.\n"
+"\t\tUse 0 for stdin/stdout, or -1 for no debug bus at all.\n"
+"\t-s name=value\tSet a simulation parameter.  Use -s ? for the list\n"
+"\t-y probes\tReport the final values of these probes (comma\n"
+"\t\tseparated) once done\n"
+"\t--stats\tReport the simulation's speed when done, and where its time\n"
+"\t\twent\n"
+"\n"
+"\tExits with 0 when done, 1 on a usage error, 2 if the simulation\n"
+"\tfails, or 3 if stopped by a signal while gathering --stats\n",
+	FPGAPORT);
 }
 // }}}
 
@@ -75,20 +151,95 @@ int	main(int argc, char **argv) {
 
 	const	char *trace_file = NULL; // "trace.vcd";
 	bool	debug_flag = false;
+	int	trace_depth = 99;
+	unsigned	flight_depth = 0;
+	const	char	*flight_probes = NULL, *flight_file = "flight.vcd";
+	uint64_t	max_ticks = 0;
+	bool		stats_flag = false;
+	const	char	*save_file = NULL, *restore_file = NULL;
+	const	char	*report_probes = NULL;
+	std::vector<const char *>	params;
+
+	// The debug bus port must be known before the MAINTB is built
+	for(int argn=1; argn+1 < argc; argn++)
+		if (strcmp(argv[argn], "-p") == 0)
+			dbgbus_port = atoi(argv[++argn]);
 
 	MAINTB	*tb = new MAINTB;
 
 	// Argument processing
 	// {{{
 	for(int argn=1; argn < argc; argn++) {
+		if (strcmp(argv[argn], "--stats") == 0) {
+			stats_flag = true;
+			continue;
+		}
+
 		if (argv[argn][0] == '-') for(int j=1;
 					(j<512)&&(argv[argn][j]);j++) {
+			if (strchr("twelvmrgxonkcpsy", tolower(argv[argn][j]))
+					&& argn+1 >= argc) {
+				fprintf(stderr, "ERR: -%c requires an argument\n\n",
+					argv[argn][j]);
+				usage();
+				exit(EXIT_FAILURE);
+			}
+
 			switch(tolower(argv[argn][j])) {
 			case 'd': debug_flag = true;
 				if (trace_file == NULL)
 					trace_file = "trace.vcd";
 				break;
-			// case 't': trace_file = argv[++argn]; j=1000; break;
+			case 't': trace_file = argv[++argn]; j=1000; break;
+			case 'w': {
+				char	*ptr;
+				uint64_t start, stop = 0;
+
+				start = strtoull(argv[++argn], &ptr, 0);
+				if (*ptr == ':')
+					stop = strtoull(ptr+1, NULL, 0);
+				tb->tracewindow(start, stop);
+				} j=1000; break;
+			case 'e':
+				if (strcmp(argv[++argn], "?") == 0) {
+					tb->m_trigger.listprobes(stdout);
+					exit(EXIT_SUCCESS);
+				} else if (!tb->settrigger(argv[argn]))
+					exit(EXIT_FAILURE);
+				j=1000; break;
+			case 'l': tb->tracelength(strtoull(argv[++argn], NULL, 0));
+				j=1000; break;
+			case 'v': trace_depth = atoi(argv[++argn]); j=1000; break;
+			case 'm': tb->tracescope(argv[++argn]); j=1000; break;
+			case 'r': flight_depth = atoi(argv[++argn]); j=1000; break;
+			case 'g': flight_probes = argv[++argn]; j=1000; break;
+			case 'x':
+				if (!tb->setfailure(argv[++argn]))
+					exit(EXIT_FAILURE);
+				j=1000; break;
+			case 'o': flight_file = argv[++argn]; j=1000; break;
+			case 'n':
+				if (0 == (max_ticks = parseticks(argv[++argn]))) {
+					fprintf(stderr, "ERR: Bad run length, %s\n",
+						argv[argn]);
+					exit(EXIT_FAILURE);
+				} j=1000; break;
+			case 'k': save_file = argv[++argn]; j=1000; break;
+			case 'c': restore_file = argv[++argn]; j=1000; break;
+			case 'p': // Already handled, above
+				if (strcmp(argv[argn], "-p") != 0) {
+					fprintf(stderr, "ERR: -p must be given on its own\n");
+					exit(EXIT_FAILURE);
+				} argn++; j=1000; break;
+			case 's':
+				// Applied below, once any checkpoint has
+				// been restored
+				if (strcmp(argv[++argn], "?") == 0) {
+					tb->listparams(stdout);
+					exit(EXIT_SUCCESS);
+				} params.push_back(argv[argn]);
+				j=1000; break;
+			case 'y': report_probes = argv[++argn]; j=1000; break;
 			case 'h': usage(); exit(0); break;
 			default:
 				fprintf(stderr, "ERR: Unexpected flag, -%c\n\n",
@@ -105,18 +256,85 @@ int	main(int argc, char **argv) {
 
 	if (debug_flag) {
 		printf("Opening design with\n");
-		printf("\tDebug Access port = %d\n", FPGAPORT); // fpga_port);
+		printf("\tDebug Access port = %d\n", dbgbus_port);
 		printf("\tVCD File         = %s\n", trace_file);
-	} if (trace_file)
-		tb->opentrace(trace_file);
+	}
+
+#ifndef	TESTB_SAVABLE
+	if (save_file || restore_file) {
+		fprintf(stderr, "ERR: -k and -c need a model built with SAVE=1\n");
+		exit(EXIT_FAILURE);
+	}
+#endif
+
+	// Restore any checkpoint first, so the trace and flight recorder start
+	// from it
+	if (restore_file) {
+		if (!tb->restore(restore_file))
+			exit(EXIT_FAILURE);
+		if (max_ticks > 0)
+			max_ticks += tb->m_tickcount;
+	}
+
+	// Parameters given with -s override those within the checkpoint
+	for(unsigned k=0; k<params.size(); k++)
+		if (!tb->setparam(params[k]))
+			exit(EXIT_FAILURE);
+
+	if (trace_file)
+		tb->opentrace(trace_file, trace_depth);
+	if (flight_depth > 0
+		&& !tb->flightrecorder(flight_depth, flight_probes, flight_file))
+		exit(EXIT_FAILURE);
+
+	if (stats_flag) {
+		struct	sigaction	sa;
+
+		tb->profile(true);
+		// Stop cleanly on a ^C, so we can report--unless the trace
+		// or flight recorder has already claimed the signal
+		sigaction(SIGINT, NULL, &sa);
+		if (sa.sa_handler == SIG_DFL)
+			signal(SIGINT, stopsim);
+		sigaction(SIGTERM, NULL, &sa);
+		if (sa.sa_handler == SIG_DFL)
+			signal(SIGTERM, stopsim);
+	}
+
+	uint64_t	start_ns = MAINTB::profclock();
+
+	if (!restore_file)
+		tb->reset();
+
+	// Run in chunks of RUN_CHUNK ticks, stopping between them for signals
+	if (max_ticks > 0) {
+		while(!m_stop && !tb->m_failed && !tb->done()
+				&& tb->m_tickcount < max_ticks) {
+			uint64_t	n = max_ticks - tb->m_tickcount;
+
+			tb->run<MAINTB>((n < RUN_CHUNK) ? n : RUN_CHUNK);
+		}
+	} else while(!m_stop && !tb->done())
+		tb->run<MAINTB>(RUN_CHUNK);
+
+	if (stats_flag)
+		tb->profreport(stdout, MAINTB::profclock() - start_ns);
+	if (report_probes && !tb->probereport(stdout, report_probes))
+		exit(EXIT_FAILURE);
 
-	tb->reset();
+	bool	failed = tb->m_failed, saved = true;
 
-	while(true)
-		tb->tick();
+	if (save_file)
+		saved = tb->save(save_file);
 
 	tb->close();
 	delete tb;
 
+	if (!saved)
+		return EXIT_FAILURE;
+	if (failed)
+		return EXIT_SIMFAIL;
+	if (m_stop)
+		return EXIT_STOPPED;
 	return	EXIT_SUCCESS;
 }
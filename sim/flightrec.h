@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	flightrec.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	A flight recorder for the simulation.  Rather than tracing an
+//		entire run, the last few thousand ticks of a handful of
+//	signals are kept in memory, and only written out (as a VCD file) if
+//	the run fails.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	FLIGHTREC_H
+#define	FLIGHTREC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+//
+// FLIGHTREC keeps the last depth samples of a set of signals, each sample
+// packed into as few 64-bit words as its signals' widths allow.  Nothing is
+// formatted until writevcd() is called, typically once something has gone
+// wrong.
+//
+class	FLIGHTREC {
+public:
+	typedef	std::function<uint64_t(void)>	PROBE;
+private:
+	typedef	struct	{
+		std::string	name;
+		PROBE		probe;
+		unsigned	width, offset;
+	} SIGNAL;
+
+	std::vector<SIGNAL>	m_sigs;
+	unsigned	m_depth, m_bits, m_words, m_next;
+	uint64_t	*m_ring;
+	uint64_t	m_count, m_lasttick;
+
+	static	uint64_t	mask(unsigned width) {
+		return (width >= 64) ? ~0ul : ((1ul << width)-1);
+	}
+
+	// getbits()
+	// {{{
+	uint64_t	getbits(const uint64_t *slot, unsigned offset,
+				unsigned width) const {
+		unsigned	word = offset / 64, sh = offset % 64;
+		uint64_t	v = slot[word] >> sh;
+
+		if (sh + width > 64)
+			v |= slot[word+1] << (64 - sh);
+		return v & mask(width);
+	}
+	// }}}
+
+	// vcdid()
+	// {{{
+	// VCD identifiers are strings of printable characters, ! through ~
+	static	std::string	vcdid(unsigned k) {
+		std::string	id;
+
+		do {
+			id += (char)('!' + (k % 94));
+			k /= 94;
+		} while(k > 0);
+		return id;
+	}
+	// }}}
+
+	// vcdvalue()
+	// {{{
+	static	void	vcdvalue(FILE *fp, uint64_t v, unsigned width,
+				const std::string &id) {
+		if (width == 1) {
+			fprintf(fp, "%c%s\n", (v&1) ? '1' : '0', id.c_str());
+			return;
+		}
+
+		fputc('b', fp);
+		for(int b = width-1; b >= 0; b--)
+			fputc(((v >> b)&1) ? '1' : '0', fp);
+		fprintf(fp, " %s\n", id.c_str());
+	}
+	// }}}
+public:
+	FLIGHTREC(unsigned depth) : m_depth(depth), m_bits(0), m_words(0),
+		m_next(0), m_ring(NULL), m_count(0), m_lasttick(0) {}
+	~FLIGHTREC(void) { delete[] m_ring; }
+
+	// add()
+	// {{{
+	// Add a signal to be recorded.  Signals may only be added before the
+	// first sample.
+	void	add(const std::string &name, PROBE probe, unsigned width) {
+		SIGNAL	sig;
+
+		if (m_ring) {
+			fprintf(stderr, "ERR: FLIGHTREC signals must be added before recording starts\n");
+			return;
+		}
+		if (width < 1 || width > 64)
+			width = 64;
+		sig.name   = name;
+		sig.probe  = probe;
+		sig.width  = width;
+		sig.offset = m_bits;
+		m_bits += width;
+		m_sigs.push_back(sig);
+	}
+	// }}}
+
+	unsigned	depth(void) const { return m_depth; }
+	unsigned	nsignals(void) const { return m_sigs.size(); }
+
+	// sample(tick)
+	// {{{
+	// Record every signal, as of the given tick
+	void	sample(uint64_t tick) {
+		if (!m_ring) {
+			m_words = (m_bits + 63) / 64;
+			if (m_words == 0)
+				m_words = 1;
+			m_ring = new uint64_t[(size_t)m_depth * m_words];
+		}
+
+		uint64_t	*slot = &m_ring[(size_t)m_next * m_words];
+		for(unsigned w=0; w<m_words; w++)
+			slot[w] = 0;
+		for(const SIGNAL &sig : m_sigs) {
+			uint64_t	v = sig.probe() & mask(sig.width);
+			unsigned	word = sig.offset / 64,
+					sh   = sig.offset % 64;
+
+			slot[word] |= v << sh;
+			if (sh + sig.width > 64)
+				slot[word+1] |= v >> (64 - sh);
+		}
+
+		if (++m_next >= m_depth)
+			m_next = 0;
+		m_count++;
+		m_lasttick = tick;
+	}
+	// }}}
+
+	// writevcd(fname, period_ps)
+	// {{{
+	// Write the samples in the ring, oldest first, to a VCD file.  Each
+	// sample is placed at its tick number times period_ps.  Returns
+	// false if the file can't be written.
+	bool	writevcd(const char *fname, uint64_t period_ps) const {
+		FILE		*fp;
+		uint64_t	nsamples, first;
+		std::vector<std::string>	ids;
+
+		if (NULL == (fp = fopen(fname, "w"))) {
+			fprintf(stderr, "ERR: Could not open %s\n", fname);
+			return false;
+		}
+
+		nsamples = (m_count < m_depth) ? m_count : m_depth;
+		first = m_lasttick + 1 - nsamples;
+
+		fprintf(fp, "$timescale 1ps $end\n");
+		fprintf(fp, "$scope module flightrec $end\n");
+		for(unsigned k=0; k<m_sigs.size(); k++) {
+			ids.push_back(vcdid(k));
+			fprintf(fp, "$var wire %u %s %s $end\n", m_sigs[k].width,
+				ids[k].c_str(), m_sigs[k].name.c_str());
+		}
+		fprintf(fp, "$upscope $end\n");
+		fprintf(fp, "$enddefinitions $end\n");
+
+		const uint64_t	*last = NULL;
+		for(uint64_t n=0; n<nsamples; n++) {
+			unsigned	idx = (m_next + m_depth - nsamples + n)
+							% m_depth;
+			const uint64_t	*slot = &m_ring[(size_t)idx * m_words];
+			bool		stamped = false;
+
+			for(unsigned k=0; k<m_sigs.size(); k++) {
+				const SIGNAL	&sig = m_sigs[k];
+				uint64_t	v = getbits(slot, sig.offset,
+							sig.width);
+
+				if (last && v == getbits(last, sig.offset,
+							sig.width))
+					continue;
+				if (!stamped)
+					fprintf(fp, "#%lu\n", (unsigned long)
+						((first + n) * period_ps));
+				stamped = true;
+				vcdvalue(fp, v, sig.width, ids[k]);
+			} last = slot;
+		}
+
+		// Mark the end of the window, even if nothing changed
+		fprintf(fp, "#%lu\n", (unsigned long)((m_lasttick+1) * period_ps));
+		fclose(fp);
+		return true;
+	}
+	// }}}
+};
+
+#endif	// FLIGHTREC_H
@@ -55,6 +55,9 @@
 #include "testb.h"
 #include "micnco.h"
 #include "uartsim.h"
+// The debug bus's TCP port.  main_tb's -p option may change it before the
+// MAINTB is built: zero uses stdin/stdout, and a negative port none at all.
+int	dbgbus_port = FPGAPORT;
 //
 // SIM.DEFINES
 //
@@ -79,10 +82,32 @@ public:
 		//
 		// From amsim
 	m_mic = new MICNCO();
+	addprobe("bomb", [this](void) -> uint64_t { return m_mic->m_bomb; });
+	addprobe("micsck", [this](void) -> uint64_t { return m_core->o_mic_sck; });
+	addprobe("miccsn", [this](void) -> uint64_t { return m_core->o_mic_csn; });
+	addprobe("micmiso", [this](void) -> uint64_t { return m_core->i_mic_miso; });
+	addstate("micnco", [this](FILE *fp) { return m_mic->save(fp); },
+		[this](FILE *fp) { return m_mic->restore(fp); });
+	addparam("micstep", [this](const char *v) {
+		char *ptr; unsigned s = strtoul(v, &ptr, 0);
+		m_mic->step(s); return *ptr == '\0'; });
 		// From hex
-		m_dbgbus = new UARTSIM(FPGAPORT);
+		m_dbgbus = new UARTSIM(dbgbus_port);
 		m_dbgbus->setup(36);
 		m_core->i_host_uart_rx = 1;
+		addprobe("uarttx", [this](void) -> uint64_t {
+			return m_core->o_host_uart_tx; });
+		addprobe("uartrx", [this](void) -> uint64_t {
+			return m_core->i_host_uart_rx; });
+		addstate("uartsim", [this](FILE *fp) {
+			return m_dbgbus->save(fp); }, [this](FILE *fp) {
+			return m_dbgbus->restore(fp); });
+		// From i2c
+		// The I2C bus itself, as seen by the design
+		addprobe("scl", [this](void) -> uint64_t {
+			return m_core->i_gpio & 1; });
+		addprobe("sda", [this](void) -> uint64_t {
+			return (m_core->i_gpio >> 1) & 1; });
 	}
 
 	void	reset(void) {
@@ -125,9 +150,17 @@ public:
 		// SIM.TICK tags go here for SIM.CLOCK=clk
 		//
 		// SIM.TICK from amsim
-	m_core->i_mic_miso= (*m_mic)(m_core->o_mic_sck, m_core->o_mic_csn);
+	TBPROFILE("micnco", setinput(m_core->i_mic_miso,
+			(*m_mic)(m_core->o_mic_sck, m_core->o_mic_csn)));
 		// SIM.TICK from hex
-		m_core->i_host_uart_rx = (*m_dbgbus)(m_core->o_host_uart_tx);
+		TBPROFILE("uartsim", setinput(m_core->i_host_uart_rx,
+				(*m_dbgbus)(m_core->o_host_uart_tx)));
+		// SIM.TICK from i2c
+		// With no I2C slave attached, the pull-ups leave each pin high
+		// unless either the GPIO or the I2C master pulls it low
+		setinput(m_core->i_gpio, (m_core->i_gpio & ~3)
+			| (((m_core->o_gpio & 1) && m_core->o_i2c_scl) ? 1:0)
+			| (((m_core->o_gpio & 2) && m_core->o_i2c_sda) ? 2:0));
 	}
 	inline	void	tick_clk(void) {	tick();	}
 
@@ -92,3 +92,19 @@ int MICNCO::operator()(int sck, int csn) {
 	return ov;
 }
 
+bool	MICNCO::save(FILE *fp) {
+	unsigned	v[7] = { m_phase, m_step, m_ticks, m_state,
+			(unsigned)m_last_sck, (unsigned)m_oreg, m_bomb };
+
+	return fwrite(v, sizeof(v), 1, fp) == 1;
+}
+
+bool	MICNCO::restore(FILE *fp) {
+	unsigned	v[7];
+
+	if (fread(v, sizeof(v), 1, fp) != 1)
+		return false;
+	m_phase = v[0]; m_step = v[1]; m_ticks = v[2]; m_state = v[3];
+	m_last_sck = (int)v[4]; m_oreg = (int)v[5]; m_bomb = (v[6] != 0);
+	return true;
+}
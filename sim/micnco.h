@@ -39,6 +39,8 @@
 #ifndef	MICNCO_H
 #define	MICNCO_H
 
+#include <stdio.h>
+
 class MICNCO {
 	unsigned	m_phase, m_step, m_ticks, m_state;
 	int		m_last_sck, m_oreg;
@@ -47,6 +49,9 @@ public:
 	MICNCO();
 	void	step(unsigned s);
 	int operator()(int sck, int csn);
+	// Save or restore the NCO's state to or from a checkpoint file
+	bool	save(FILE *fp);
+	bool	restore(FILE *fp);
 };
 
 #endif
@@ -0,0 +1,150 @@
+#!/bin/bash
+################################################################################
+##
+## Filename:	simbench.sh
+## {{{
+## Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+##
+## Purpose:	To measure how fast each build variant of the simulation runs,
+##		for each of the full transmit/receive RF configurations, so
+##	we know which build to use for long regression runs.
+##
+##	Usage:	simbench.sh [-n ticks] [-c "configs"] [-v "variants"] [-j N]
+##
+##	Each configuration (amsim, fmsim, qpsksim, and wavsim by default) is
+##	built in turn by autofpga, and then each variant of main_tb is built
+##	for it and run headless for the given number of clock ticks.  The
+##	variants are:
+##
+##	base	The normal build: a traced model, and a debug (-Og -g) main_tb
+##	mt	As base, but with the model evaluated on N threads
+##	fast	No tracing, -O3 -march=native, and link time optimization
+##	fastmt	As fast, but with the model evaluated on N threads
+##
+##	The files autofpga writes are restored once done.  Build logs are
+##	left in simbench.log.
+##
+## Creator:	Dan Gisselquist, Ph.D.
+##		Gisselquist Technology, LLC
+##
+################################################################################
+## }}}
+## Copyright (C) 2019-2024, Gisselquist Technology, LLC
+## {{{
+## This program is free software (firmware): you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as published
+## by the Free Software Foundation, either version 3 of the License, or (at
+## your option) any later version.
+##
+## This program is distributed in the hope that it will be useful, but WITHOUT
+## ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+## FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+## for more details.
+##
+## You should have received a copy of the GNU General Public License along
+## with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+## target there if the PDF file isn't present.)  If not, see
+## <http://www.gnu.org/licenses/> for a copy.
+## }}}
+## License:	GPL, v3, as defined and found on www.gnu.org,
+## {{{
+##		http://www.gnu.org/licenses/gpl.html
+##
+################################################################################
+##
+## }}}
+TICKS=${BENCH_TICKS:-20000000}
+CONFIGS="amsim fmsim qpsksim wavsim"
+VARIANTS="base mt fast fastmt"
+NTHREADS=4
+
+while getopts "n:c:v:j:h" opt
+do
+  case $opt in
+  n) TICKS=$OPTARG ;;
+  c) CONFIGS=$OPTARG ;;
+  v) VARIANTS=$OPTARG ;;
+  j) NTHREADS=$OPTARG ;;
+  *) echo "Usage: $0 [-n ticks] [-c \"configs\"] [-v \"variants\"] [-j threads]"
+     exit 1 ;;
+  esac
+done
+
+MAKE="make --no-print-directory"
+cd `dirname $0`/..
+LOG=`pwd`/sim/simbench.log
+rm -f $LOG
+
+## The make options for each variant
+## {{{
+variant_flags() {
+  case $1 in
+  base)   echo "" ;;
+  mt)     echo "THREADS=$NTHREADS" ;;
+  fast)   echo "TRACE=none OPT=release" ;;
+  fastmt) echo "TRACE=none OPT=release THREADS=$NTHREADS" ;;
+  *)      return 1 ;;
+  esac
+}
+## }}}
+
+## Save the files "make autodata" will overwrite, and put them back when done.
+## (The hand maintained sim/testb.h isn't among them.)
+## {{{
+GENFILES="rtl/toplevel.v rtl/main.v rtl/sdr.pcf rtl/make.inc rtl/builddate.v
+	sw/regdefs.h sw/regdefs.cpp sim/main_tb.cpp"
+SAVED=`mktemp -d`
+tar -cf $SAVED/gen.tar $GENFILES
+restore() {
+  tar -xf $SAVED/gen.tar
+  rm -rf $SAVED
+}
+trap restore EXIT
+## }}}
+
+if ! which autofpga > /dev/null 2>&1
+then
+  echo "autofpga not found, only the current configuration will be measured"
+  CONFIGS=current
+fi
+
+printf "%-10s %-8s %14s %8s\n" "Config" "Variant" "Ticks/s" "Speedup"
+for cfg in $CONFIGS
+do
+  if [[ $cfg != current ]] && ! $MAKE autodata RF=$cfg.txt >> $LOG 2>&1
+  then
+    printf "%-10s %-8s %14s\n" $cfg "" "(autofpga failed)"
+    continue
+  fi
+
+  baserate=""
+  for v in $VARIANTS
+  do
+    if ! flags=`variant_flags $v`
+    then
+      echo "Unknown variant: $v"
+      exit 1
+    fi
+
+    if ! ( $MAKE -C rtl sim $flags && $MAKE -C sim $flags all ) >> $LOG 2>&1
+    then
+      printf "%-10s %-8s %14s\n" $cfg $v "(build failed)"
+      continue
+    fi
+
+    rate=`$MAKE -s -C sim $flags bench BENCH_TICKS=$TICKS 2>> $LOG \
+		| tee -a $LOG | grep "^Rate:" | awk '{ print $2 }'`
+    if [[ -z $rate ]]
+    then
+      printf "%-10s %-8s %14s\n" $cfg $v "(run failed)"
+      continue
+    fi
+
+    if [[ -z $baserate ]]
+    then
+      baserate=$rate
+    fi
+    awk -v c=$cfg -v v=$v -v r=$rate -v b=$baserate \
+	'BEGIN { printf("%-10s %-8s %14s %7.2fx\n", c, v, r, r/b) }'
+  done
+done
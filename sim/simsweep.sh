@@ -0,0 +1,167 @@
+#!/bin/bash
+################################################################################
+##
+## Filename:	simsweep.sh
+## {{{
+## Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+##
+## Purpose:	To run a sweep of many headless simulations in parallel, one
+##		per core, and collect their results into a single table.
+##
+##	Usage:	simsweep.sh [-j jobs] [-n len] [-b main_tb] [-p port]
+##			[-o dir] sweepfile [main_tb arguments ...]
+##
+##	Each line of the sweep file holds the main_tb arguments for one run,
+##	such as "-s micstep=4000".  Blank lines, and lines beginning with a
+##	#, are skipped.  Any further arguments on the command line, such as
+##	"-c locked.ckp -y bomb", are given to every run.
+##
+##	-j jobs	Run this many simulations at once (default: one per core).
+##		Each job is pinned to a core of its own, so build main_tb
+##		without THREADS for sweeps.
+##	-n len	Run each simulation for this long (default: 20000000 ticks)
+##	-b exe	The main_tb to run, such as main_tb-none-rel
+##	-p port	Give run number k the debug bus port, port+k.  Otherwise,
+##		no run has a debug bus at all.
+##	-o dir	Where to keep each run's output (default: sweep/)
+##
+##	The table gives each run's exit code (see main_tb -h), speed, and
+##	the final value of any probes given with -y.
+##
+## Creator:	Dan Gisselquist, Ph.D.
+##		Gisselquist Technology, LLC
+##
+################################################################################
+## }}}
+## Copyright (C) 2019-2024, Gisselquist Technology, LLC
+## {{{
+## This program is free software (firmware): you can redistribute it and/or
+## modify it under the terms of the GNU General Public License as published
+## by the Free Software Foundation, either version 3 of the License, or (at
+## your option) any later version.
+##
+## This program is distributed in the hope that it will be useful, but WITHOUT
+## ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+## FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+## for more details.
+##
+## You should have received a copy of the GNU General Public License along
+## with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+## target there if the PDF file isn't present.)  If not, see
+## <http://www.gnu.org/licenses/> for a copy.
+## }}}
+## License:	GPL, v3, as defined and found on www.gnu.org,
+## {{{
+##		http://www.gnu.org/licenses/gpl.html
+##
+################################################################################
+##
+## }}}
+NCPUS=`nproc`
+JOBS=$NCPUS
+LEN=20000000
+MAINTB=./main_tb
+PORT=
+OUTD=sweep
+
+while getopts "j:n:b:p:o:h" opt
+do
+  case $opt in
+  j) JOBS=$OPTARG ;;
+  n) LEN=$OPTARG ;;
+  b) MAINTB=$OPTARG ;;
+  p) PORT=$OPTARG ;;
+  o) OUTD=$OPTARG ;;
+  *) echo "Usage: $0 [-j jobs] [-n len] [-b main_tb] [-p port] [-o dir] sweepfile [main_tb arguments ...]"
+     exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+if [[ $# -lt 1 || ! -r $1 ]]
+then
+  echo "No sweep file given"
+  exit 1
+fi
+SWEEP=$1
+shift
+
+## Read the runs
+## {{{
+RUNS=()
+while read -r line
+do
+  if [[ -n $line && ${line:0:1} != "#" ]]
+  then
+    RUNS+=("$line")
+  fi
+done < $SWEEP
+NRUNS=${#RUNS[@]}
+## }}}
+
+mkdir -p $OUTD
+rm -f $OUTD/run*.txt $OUTD/run*.rc
+
+if which taskset > /dev/null 2>&1
+then
+  PIN=taskset
+else
+  PIN=
+fi
+
+## worker k
+## {{{
+## Run every JOBS'th run, starting with run k, on core k
+worker() {
+  local k=$1 r port
+  shift
+  for((r=k; r<NRUNS; r+=JOBS))
+  do
+    if [[ -n $PORT ]]
+    then
+      port=$((PORT+r))
+    else
+      port=-1
+    fi
+    ## The -- keeps taskset from taking main_tb's options as its own
+    ${PIN:+$PIN -c -- $((k % NCPUS))} $MAINTB -p $port -n $LEN --stats \
+	"$@" ${RUNS[$r]} > $OUTD/run$r.txt 2>&1
+    echo $? > $OUTD/run$r.rc
+  done
+}
+## }}}
+
+echo "Running $NRUNS simulations, $JOBS at a time"
+for((k=0; k<JOBS && k<NRUNS; k++))
+do
+  worker $k "$@" &
+done
+wait
+
+## The results table
+## {{{
+for((r=0; r<NRUNS; r++))
+do
+  echo "RUN $r `cat $OUTD/run$r.rc` ${RUNS[$r]}"
+  grep "^Rate:\|^Probe " $OUTD/run$r.txt
+done | awk '
+  /^RUN / {
+	run = $2; nruns = run+1; code[run] = $3;
+	$1 = $2 = $3 = ""; sub(/^ +/, ""); args[run] = $0; next }
+  /^Rate:/ { rate[run] = $2; next }
+  /^Probe / {
+	if (!($2 in seen)) { seen[$2] = 1; names[nnames++] = $2; }
+	value[run, $2] = $3; next }
+  END {
+	printf("%4s %4s %12s", "Run", "Exit", "Ticks/s");
+	for(n=0; n<nnames; n++)
+		printf(" %12s", names[n]);
+	printf("  %s\n", "Arguments");
+	for(r=0; r<nruns; r++) {
+		printf("%4d %4d %12s", r, code[r], (r in rate) ? rate[r] : "-");
+		for(n=0; n<nnames; n++) {
+			key = r SUBSEP names[n];
+			printf(" %12s", (key in value) ? value[key] : "-");
+		}
+		printf("  %s\n", args[r]);
+	} }'
+## }}}
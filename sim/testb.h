@@ -1,14 +1,16 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Filename:	./testb.h
+// Filename:	testb.h
 // {{{
 // Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
 //
-// DO NOT EDIT THIS FILE!
-// Computer Generated: This file is computer generated by AUTOFPGA. DO NOT EDIT.
-// DO NOT EDIT THIS FILE!
+// Purpose:	A wrapper for a Verilator generated core, providing clocking,
+//		tracing (with triggers and a flight recorder), profiling,
+//	checkpoints, and a fast path for untraced runs.
 //
-// CmdLine:	autofpga autofpga -d -o . global.txt clock36.txt version.txt hexbus.txt gpio.txt qpsksim.txt histogram.txt rfscope.txt samplerate.txt
+//	This file began life as the testb.h generated by AUTOFPGA, but is now
+//	maintained by hand.  "make autodata" still generates autodata/testb.h,
+//	but no longer copies it here.
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -43,15 +45,84 @@
 #define	TESTB_H
 
 // #define TRACE_FST
+// #define TRACE_NONE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
 #ifdef	TRACE_FST
 #define	TRACECLASS	VerilatedFstC
 #include <verilated_fst_c.h>
 #else // TRACE_FST
 #define	TRACECLASS	VerilatedVcdC
 #include <verilated_vcd_c.h>
+#include "tracefile.h"
+#endif
+#include "tracetrig.h"
+#include "flightrec.h"
+#ifdef	TESTB_SAVABLE
+#include <verilated_save.h>
+#endif
+
+// Traces are flushed at most once every TESTB_FLUSH_MS milliseconds (see
+// setflush()), and otherwise only as Verilator's buffers fill.  The clock is
+// only checked every TESTB_FLUSH_TICKS ticks.
+#define	TESTB_FLUSH_MS		1000
+#define	TESTB_FLUSH_TICKS	4096
+
+// Checkpoints (see save()) begin their harness state with this
+#define	TESTB_CKPT_MAGIC	"TESTBCK1"
+
+// The simulated clock period
+#define	TESTB_PERIOD_PS		(13888+13889)
+
+// Profiling
+// {{{
+// When enabled (see profile()), one tick in every TESTB_PROF_INTERVAL is
+// timed, piece by piece, and the totals scaled up to estimate where the
+// simulation's time goes.  The first few slots are TESTB's own.  Simulation
+// components may claim the rest by wrapping their @SIM.TICK code in
+// TBPROFILE("name", code), with the time they take counted both within their
+// own slot and within TESTB_PROF_SIM.
+#define	TESTB_PROF_INTERVAL	256	// Must be a power of two
+#define	TESTB_PROF_SLOTS	8
+#define	TESTB_PROF_EVAL		0
+#define	TESTB_PROF_TRACE	1
+#define	TESTB_PROF_SIM		2
+#define	TESTB_PROF_FIRST	3	// The first slot for components
+
+#define	TBPROFILE(NAME, STMT)	do {					\
+		if (m_profiling) {					\
+			static	int	_slot = -1;			\
+			if (_slot < 0)	_slot = profslot(NAME);		\
+			uint64_t _t0 = profclock();			\
+			STMT;						\
+			profadd(_slot, _t0);				\
+			m_prof_nested++;				\
+		} else { STMT; }					\
+	} while(0)
+// }}}
+
+// A signal arriving while a trace is open is only noted by the handler.  The
+// trace is then closed, and the signal raised again, at the next flush check.
+static	volatile sig_atomic_t	testb_trace_signal = 0;
+static	TRACECLASS		*testb_open_trace = NULL;
+
+static	void	testb_trace_sighandler(int sig) {
+	testb_trace_signal = sig;
+}
+
+#ifndef	TRACE_NONE
+// Close whatever trace remains open should the program exit() without
+// closing it first
+static	void	testb_trace_atexit(void) {
+	if (testb_open_trace)
+		testb_open_trace->close();
+	testb_open_trace = NULL;
+}
 #endif
 
 	//
@@ -69,6 +140,44 @@ public:
 	TRACECLASS*	m_trace;
 	bool		m_done, m_paused_trace;
 	uint64_t	m_time_ps;
+#ifndef	TRACE_FST
+	TRACEFILE	*m_tracefile;
+#endif
+	unsigned	m_flush_ms, m_flush_countdown;
+	uint64_t	m_last_flush_ms;
+	bool		m_sighandlers;
+	// The number of ticks so far
+	uint64_t	m_tickcount;
+	// Trace control.  Once opened, a trace records nothing (it is gated)
+	// until m_trace_start ticks have passed and the trigger, if any, has
+	// fired.  It is then closed at m_trace_stop, if non-zero, or
+	// m_trace_length ticks after it started, if that's sooner.
+	bool		m_trace_gated;
+	uint64_t	m_trace_start, m_trace_stop, m_trace_length;
+	std::string	m_trace_scope;
+	TRACETRIGGER	m_trigger;
+	// The flight recorder, if any, the file it's written to on failure,
+	// and the expression (of the same probes) that defines a failure
+	FLIGHTREC	*m_flight;
+	std::string	m_flight_file;
+	TRACETRIGGER	m_failtrig;
+	bool		m_failed;
+	// Profiling: m_profiling is true during those ticks being timed
+	bool		m_prof_enabled, m_profiling;
+	uint64_t	m_prof_ns[TESTB_PROF_SLOTS], m_prof_overhead_ns;
+	const char	*m_prof_name[TESTB_PROF_SLOTS];
+	unsigned	m_prof_nslots, m_prof_nested;
+	uint64_t	m_prof_tick0;
+	// The simulation components' own state, to be kept in checkpoints
+	typedef	std::function<bool(FILE *)>	STATEFN;
+	struct	TBSTATE {
+		std::string	name;
+		STATEFN		save, restore;
+	};
+	std::vector<TBSTATE>	m_states;
+	// Parameters of the simulation components, which may be set by name
+	typedef	std::function<bool(const char *)>	PARAMFN;
+	std::map<std::string, PARAMFN>	m_params;
 
 	//
 	// Since design has only one clock within it, we won't need to use the
@@ -81,10 +190,37 @@ public:
 		m_trace    = NULL;
 		m_done     = false;
 		m_paused_trace = false;
+#ifndef	TRACE_FST
+		m_tracefile = NULL;
+#endif
+		m_flush_ms = TESTB_FLUSH_MS;
+		m_flush_countdown = TESTB_FLUSH_TICKS;
+		m_last_flush_ms = 0;
+		m_sighandlers = false;
+		m_tickcount = 0;
+		m_trace_gated = false;
+		m_trace_start = m_trace_stop = m_trace_length = 0;
+		m_flight = NULL;
+		m_failed = false;
+		m_prof_enabled = m_profiling = false;
+		m_prof_overhead_ns = 0;
+		m_prof_tick0 = 0;
+		for(unsigned k=0; k<TESTB_PROF_SLOTS; k++) {
+			m_prof_ns[k] = 0;
+			m_prof_name[k] = NULL;
+		}
+		m_prof_name[TESTB_PROF_EVAL]  = "eval";
+		m_prof_name[TESTB_PROF_TRACE] = "trace";
+		m_prof_name[TESTB_PROF_SIM]   = "sim";
+		m_prof_nslots = TESTB_PROF_FIRST;
+		m_prof_nested = 0;
+		addprobe("tick", [this](void) -> uint64_t {
+			return m_tickcount; }, 64);
 		Verilated::traceEverOn(true);
 	}
 	virtual ~TESTB(void) {
-		if (m_trace) m_trace->close();
+		closetrace();
+		delete m_flight;
 		delete m_core;
 		m_core = NULL;
 	}
@@ -95,17 +231,546 @@ public:
 	// Useful for beginning a (VCD) trace.  To open such a trace, just call
 	// opentrace() with the name of the VCD file you'd like to trace
 	// everything into
+	//
+	// VCD traces are written to disk by a separate thread (see
+	// tracefile.h).  FST traces are left to Verilator, which will use its
+	// own threads if the model was built with --trace-threads.
+	//
+	// Only depth levels of hierarchy are traced, and then only beneath
+	// the scope set by tracescope(), if any.
+	//
+	// A model built with TRACE=none can't be traced at all.
 	virtual	void	opentrace(const char *vcdname, int depth=99) {
+#ifdef	TRACE_NONE
+		fprintf(stderr, "TRACE: %s not written, the model was built "
+			"without tracing\n", vcdname);
+#else
 		if (!m_trace) {
+#ifdef	TRACE_FST
 			m_trace = new TRACECLASS;
-			m_core->trace(m_trace, 99);
+#else
+			m_tracefile = new TRACEFILE;
+			m_trace = new TRACECLASS(m_tracefile);
+#endif
+#ifdef	ROOT_VERILATOR
+			// Older Verilators ignore the depth given to trace()
+			m_trace->dumpvars(depth, m_trace_scope);
+#endif
+			m_core->trace(m_trace, depth);
 			m_trace->spTrace()->set_time_resolution("ps");
 			m_trace->spTrace()->set_time_unit("ps");
 			m_trace->open(vcdname);
 			m_paused_trace = false;
+			m_trace_gated = (m_trace_start > 0) || m_trigger.armed();
+			m_flush_countdown = TESTB_FLUSH_TICKS;
+			m_last_flush_ms = now_ms();
+
+			static	bool	registered = false;
+			if (!registered)
+				atexit(testb_trace_atexit);
+			registered = true;
+			testb_open_trace = m_trace;
+			catchsignals(true);
+		}
+#endif
+	}
+
+	//
+	// tracewindow(start, stop)
+	//
+	// Only record the trace from tick number start until (but not
+	// including) tick number stop.  A stop of zero records until the
+	// trace is closed.
+	void	tracewindow(uint64_t start, uint64_t stop = 0) {
+		m_trace_start = start;
+		m_trace_stop  = stop;
+	}
+
+	//
+	// tracelength(ticks)
+	//
+	// Close the trace once it has recorded this many ticks
+	void	tracelength(uint64_t ticks) {
+		m_trace_length = ticks;
+	}
+
+	//
+	// tracescope(scope)
+	//
+	// Only trace the signals beneath the given scope, as in
+	// "TOP.main.u_rcvr" (Verilator 4.2 and later)
+	void	tracescope(const char *scope) {
+		m_trace_scope = (scope) ? scope : "";
+	}
+
+	//
+	// addprobe(name, probe, width), settrigger(expr)
+	//
+	// Register a named probe of the simulation's state, and set an
+	// expression of probes (see tracetrig.h) which must be true before
+	// anything will be traced.  settrigger() returns false if the
+	// expression can't be parsed.
+	void	addprobe(const char *name, TRACETRIGGER::PROBE probe,
+			unsigned width = 1) {
+		m_trigger.addprobe(name, probe, width);
+		m_failtrig.addprobe(name, probe, width);
+	}
+
+	bool	settrigger(const char *expr) {
+		return m_trigger.set(expr);
+	}
+
+	//
+	// addstate(name, save, restore)
+	//
+	// Simulation components with state of their own register it here,
+	// from their @SIM.INIT tags, so that it will be saved with (and
+	// restored from) any checkpoint.
+	void	addstate(const char *name, STATEFN save, STATEFN restore) {
+		m_states.push_back({ name, save, restore });
+	}
+
+	//
+	// addparam(name, set)
+	//
+	// Simulation components may also register parameters, from their
+	// @SIM.INIT tags, so that each run may set them differently.  set()
+	// is given the parameter's value as a string, and returns false if
+	// that value is no good.
+	void	addparam(const char *name, PARAMFN set) {
+		m_params[name] = set;
+	}
+
+	//
+	// setparam(assignment)
+	//
+	// Set a parameter, given an assignment of the form name=value.
+	// Returns false, with a message, on any error.
+	bool	setparam(const char *assignment) {
+		const char	*eq = strchr(assignment, '=');
+
+		if (!eq) {
+			fprintf(stderr, "ERR: %s isn't of the form name=value\n",
+				assignment);
+			return false;
+		}
+
+		auto	it = m_params.find(std::string(assignment,
+						eq-assignment));
+		if (it == m_params.end()) {
+			fprintf(stderr, "ERR: No such parameter in %s\n",
+				assignment);
+			listparams(stderr);
+			return false;
+		} else if (!it->second(eq+1)) {
+			fprintf(stderr, "ERR: Bad value, %s\n", assignment);
+			return false;
+		} return true;
+	}
+
+	void	listparams(FILE *fp) const {
+		fprintf(fp, "Parameters:");
+		for(auto it = m_params.begin(); it != m_params.end(); it++)
+			fprintf(fp, " %s", it->first.c_str());
+		fprintf(fp, "\n");
+	}
+
+	//
+	// probereport(fp, signals)
+	//
+	// Write the current value of each of the named probes (a comma
+	// separated list), one per line, as a result of the run.  Returns
+	// false if any of them can't be found.
+	bool	probereport(FILE *fp, const char *signals) {
+		bool	found = true;
+
+		for(const std::string &nm : namelist(signals)) {
+			TRACETRIGGER::PROBE	probe;
+			unsigned		width;
+
+			if (m_trigger.findprobe(nm, probe, width))
+				fprintf(fp, "Probe %-10s %12lu\n", nm.c_str(),
+					(unsigned long)probe());
+			else {
+				fprintf(stderr, "ERR: No such probe, %s\n",
+					nm.c_str());
+				found = false;
+			}
+		} return found;
+	}
+
+	//
+	// namelist(list)
+	//
+	// Split a comma separated list of names
+	static	std::vector<std::string>	namelist(const char *list) {
+		std::vector<std::string>	names;
+		std::string	str = list;
+		size_t		start = 0, end;
+
+		do {
+			end = str.find(',', start);
+			if (end == std::string::npos)
+				end = str.size();
+			if (end > start)
+				names.push_back(str.substr(start, end-start));
+			start = end+1;
+		} while(end < str.size());
+
+		return names;
+	}
+
+	//
+	// save(fname)
+	//
+	// Save the whole simulation to a checkpoint file: the model, the
+	// simulation time, and every component registered with addstate().
+	// This requires a model built with SAVE=1 (Verilator's --savable).
+	// Neither traces nor the flight recorder are saved.
+	virtual	bool	save(const char *fname) {
+#ifdef	TESTB_SAVABLE
+		char	*buf = NULL;
+		size_t	len = 0;
+		FILE	*fp;
+		bool	ok;
+
+		// Components save themselves via stdio, into memory, so that
+		// all of it can follow the model into the one file
+		if (NULL == (fp = open_memstream(&buf, &len)))
+			return false;
+		ok = savestate(fp);
+		fclose(fp);
+
+		if (ok) {
+			VerilatedSave	os;
+			uint64_t	n = len;
+
+			os.open(fname);
+			if (os.isOpen()) {
+				os << *m_core;
+				os << n;
+				os.write(buf, len);
+				os.close();
+			} else
+				ok = false;
+		}
+		free(buf);
+
+		if (!ok)
+			fprintf(stderr, "ERR: Could not save %s\n", fname);
+		return ok;
+#else
+		fprintf(stderr, "ERR: Can't save %s, the model wasn't built "
+			"with SAVE=1\n", fname);
+		return false;
+#endif
+	}
+
+	//
+	// restore(fname)
+	//
+	// Restore the simulation from a checkpoint written by save().  The
+	// model and components must match those that wrote it.  Open any
+	// trace or flight recorder afterwards, not before.
+	virtual	bool	restore(const char *fname) {
+#ifdef	TESTB_SAVABLE
+		VerilatedRestore	is;
+		uint64_t		n;
+		char			*buf;
+		FILE			*fp;
+		bool			ok;
+
+		is.open(fname);
+		if (!is.isOpen()) {
+			fprintf(stderr, "ERR: Could not open %s\n", fname);
+			return false;
+		}
+		is >> *m_core;
+		is >> n;
+		buf = (char *)malloc(n ? n : 1);
+		is.read(buf, n);
+		is.close();
+
+		fp = fmemopen(buf, n, "r");
+		ok = (fp != NULL) && restorestate(fp);
+		if (fp)
+			fclose(fp);
+		free(buf);
+
+		if (!ok)
+			fprintf(stderr, "ERR: %s doesn't match this simulation\n",
+				fname);
+		return ok;
+#else
+		fprintf(stderr, "ERR: Can't restore %s, the model wasn't built "
+			"with SAVE=1\n", fname);
+		return false;
+#endif
+	}
+
+	//
+	// savestate(fp), restorestate(fp)
+	//
+	// The harness's part of a checkpoint: the simulation time, followed by
+	// each component's state under its name
+	bool	savestate(FILE *fp) {
+		uint64_t	v[3] = { m_time_ps, m_tickcount, m_states.size() };
+
+		if (fwrite(TESTB_CKPT_MAGIC, 8, 1, fp) != 1
+				|| fwrite(v, sizeof(v), 1, fp) != 1)
+			return false;
+		for(auto &st : m_states) {
+			unsigned	ln = st.name.size();
+
+			if (fwrite(&ln, sizeof(ln), 1, fp) != 1
+				|| fwrite(st.name.c_str(), ln, 1, fp) != 1
+				|| !st.save(fp))
+				return false;
+		}
+		return true;
+	}
+
+	bool	restorestate(FILE *fp) {
+		char		magic[8];
+		uint64_t	v[3];
+
+		if (fread(magic, 8, 1, fp) != 1
+				|| memcmp(magic, TESTB_CKPT_MAGIC, 8) != 0
+				|| fread(v, sizeof(v), 1, fp) != 1
+				|| v[2] != m_states.size())
+			return false;
+		m_time_ps   = v[0];
+		m_tickcount = v[1];
+		for(auto &st : m_states) {
+			char		name[64];
+			unsigned	ln;
+
+			if (fread(&ln, sizeof(ln), 1, fp) != 1
+				|| ln != st.name.size() || ln >= sizeof(name)
+				|| fread(name, ln, 1, fp) != 1
+				|| memcmp(name, st.name.c_str(), ln) != 0
+				|| !st.restore(fp))
+				return false;
+		}
+		m_done = m_failed = false;
+		return true;
+	}
+
+	//
+	// flightrecorder(depth, signals, fname)
+	//
+	// Keep the last depth ticks of the named probes (a comma separated
+	// list, or every probe but "tick" if NULL) in memory, to be written to
+	// fname should the simulation fail.  Returns false if any of the
+	// probes can't be found.
+	bool	flightrecorder(unsigned depth, const char *signals = NULL,
+			const char *fname = "flight.vcd") {
+		std::vector<std::string>	names;
+		FLIGHTREC	*rec;
+
+		if (signals)
+			names = namelist(signals);
+		else for(const std::string &nm : m_trigger.probenames())
+			if (nm != "tick")
+				names.push_back(nm);
+
+		rec = new FLIGHTREC(depth);
+		for(const std::string &nm : names) {
+			TRACETRIGGER::PROBE	probe;
+			unsigned		width;
+
+			if (!m_trigger.findprobe(nm, probe, width)) {
+				fprintf(stderr, "ERR: No such probe, %s\n",
+					nm.c_str());
+				m_trigger.listprobes(stderr);
+				delete rec;
+				return false;
+			}
+			rec->add(nm, probe, width);
+		}
+
+		delete m_flight;
+		m_flight = rec;
+		m_flight_file = fname;
+		m_failed = false;
+		catchsignals(true);
+		return true;
+	}
+
+	//
+	// setfailure(expr)
+	//
+	// Set the expression of probes that, once true, marks the simulation
+	// as having failed.  Returns false if the expression can't be parsed.
+	bool	setfailure(const char *expr) {
+		return m_failtrig.set(expr);
+	}
+
+	//
+	// failure(why)
+	//
+	// Simulation components may call this when something goes wrong.
+	// The first call writes out the flight recorder, if there is one.
+	virtual	void	failure(const char *why) {
+		if (m_failed)
+			return;
+		m_failed = true;
+		fprintf(stderr, "FAILURE at tick %lu: %s\n",
+			(unsigned long)m_tickcount, why);
+		if (m_flight && m_flight->writevcd(m_flight_file.c_str(),
+						TESTB_PERIOD_PS))
+			fprintf(stderr, "FLIGHTREC: Last %u ticks written to %s\n",
+				m_flight->depth(), m_flight_file.c_str());
+	}
+
+	//
+	// profile(on)
+	//
+	// Turn on (or off) the sampling profiler, as described above
+	void	profile(bool on) {
+		m_prof_enabled = on;
+		// Only count the ticks from here, as from a checkpoint
+		m_prof_tick0 = m_tickcount;
+		if (on && m_prof_overhead_ns == 0) {
+			// Measure the cost of reading the clock, so that it
+			// may be taken back out of every measurement
+			const	unsigned	NCAL = 1000;
+			uint64_t	t0 = profclock(), t1 = t0;
+			for(unsigned k=0; k<NCAL; k++)
+				t1 = profclock();
+			m_prof_overhead_ns = (t1 - t0) / NCAL;
+		}
+	}
+
+	static	uint64_t	profclock(void) {
+		struct	timespec	ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+	}
+
+	// Claim a profiling slot for a simulation component
+	int	profslot(const char *name) {
+		for(unsigned k=TESTB_PROF_FIRST; k<m_prof_nslots; k++)
+			if (strcmp(m_prof_name[k], name) == 0)
+				return k;
+		if (m_prof_nslots >= TESTB_PROF_SLOTS)
+			return TESTB_PROF_SIM;
+		m_prof_name[m_prof_nslots] = name;
+		return m_prof_nslots++;
+	}
+
+	// Add the time since t0 to a slot, less the time spent reading the
+	// clock--including the two reads of each of nested measurements
+	void	profadd(int slot, uint64_t t0, unsigned nested = 0) {
+		uint64_t	dt = profclock() - t0,
+				cost = (1 + 2*nested) * m_prof_overhead_ns;
+
+		m_prof_ns[slot] += (dt > cost) ? dt - cost : 0;
+	}
+
+	//
+	// profreport(fp, wall_ns)
+	//
+	// Report the simulation's speed, and where its time went, given the
+	// wall clock time (in ns) taken by all the ticks so far
+	void	profreport(FILE *fp, uint64_t wall_ns) {
+		double	wall_s = wall_ns * 1e-9;
+		uint64_t	components = 0,
+				ticks = m_tickcount - m_prof_tick0;
+
+		fprintf(fp, "Ticks:      %12lu (%.6f s simulated)\n",
+			(unsigned long)ticks,
+			ticks * (double)TESTB_PERIOD_PS * 1e-12);
+		if (m_prof_tick0 > 0)
+			fprintf(fp, "From tick:  %12lu\n",
+				(unsigned long)m_prof_tick0);
+		fprintf(fp, "Wall time:  %12.3f s\n", wall_s);
+		if (wall_s > 0.0)
+			fprintf(fp, "Rate:       %12.0f ticks/s\n",
+				ticks / wall_s);
+		if (!m_prof_enabled || wall_ns == 0)
+			return;
+
+		// Split the wall clock time in the same proportions as the
+		// time measured within the timed ticks.  What wasn't measured
+		// at all is the loop itself, flushing, and measurement.
+		uint64_t	timed = m_prof_ns[TESTB_PROF_EVAL]
+					+ m_prof_ns[TESTB_PROF_TRACE]
+					+ m_prof_ns[TESTB_PROF_SIM],
+				est = timed * TESTB_PROF_INTERVAL;
+		double		scale;
+
+		if (timed == 0)
+			return;
+		scale = (est < wall_ns) ? (double)est / timed : (double)wall_ns / timed;
+		for(unsigned k=0; k<m_prof_nslots; k++) {
+			double	ns = m_prof_ns[k] * scale;
+
+			if (k >= TESTB_PROF_FIRST)
+				components += m_prof_ns[k];
+			if (k == TESTB_PROF_SIM)
+				continue;
+			fprintf(fp, "  %-10s %12.3f s  %5.1f%%\n",
+				m_prof_name[k], ns * 1e-9, 100.0 * ns / wall_ns);
+		}
+
+		uint64_t	sim = m_prof_ns[TESTB_PROF_SIM];
+		sim = (sim > components) ? sim - components : 0;
+		fprintf(fp, "  %-10s %12.3f s  %5.1f%%\n", "other sim",
+			sim * scale * 1e-9, 100.0 * sim * scale / wall_ns);
+		if (est < wall_ns)
+			fprintf(fp, "  %-10s %12.3f s  %5.1f%%\n", "untimed",
+				(wall_ns - est) * 1e-9,
+				100.0 * (wall_ns - est) / wall_ns);
+	}
+
+	//
+	// tracecontrol()
+	//
+	// Called once per tick while a trace is open, to start (or stop)
+	// recording as the window and trigger require
+	void	tracecontrol(void) {
+		if (m_trace_gated) {
+			if (m_tickcount < m_trace_start)
+				return;
+			if (m_trigger.armed() && !m_trigger())
+				return;
+
+			m_trace_gated = false;
+			if (m_trace_length && (!m_trace_stop
+					|| m_tickcount + m_trace_length < m_trace_stop))
+				m_trace_stop = m_tickcount + m_trace_length;
+			fprintf(stderr, "TRACE: Started at tick %lu\n",
+				(unsigned long)m_tickcount);
+		} else if (m_trace_stop && m_tickcount >= m_trace_stop) {
+			fprintf(stderr, "TRACE: Stopped at tick %lu\n",
+				(unsigned long)m_tickcount);
+			closetrace();
 		}
 	}
 
+	//
+	// setflush(ms)
+	//
+	// Sets the longest time, in milliseconds, that may pass between
+	// flushes of the trace file, so that a trace may be viewed while the
+	// simulation is still running.  Zero flushes at every check.
+	void	setflush(unsigned ms) {
+		m_flush_ms = ms;
+	}
+
+	//
+	// flushtrace()
+	//
+	// Push everything traced so far towards the file.  For VCD traces,
+	// this only hands the data to the writer thread.
+	void	flushtrace(void) {
+		if (m_trace)
+			m_trace->flush();
+		m_last_flush_ms = now_ms();
+	}
+
 	//
 	// trace()
 	//
@@ -146,10 +811,80 @@ public:
 	// to it
 	virtual	void	closetrace(void) {
 		if (m_trace) {
+			if (!m_flight)
+				catchsignals(false);
+			if (testb_open_trace == m_trace)
+				testb_open_trace = NULL;
 			m_trace->close();
 			delete m_trace;
 			m_trace = NULL;
 		}
+#ifndef	TRACE_FST
+		// Only once the trace has been closed, since closing it
+		// writes the last of its buffer
+		delete m_tracefile;
+		m_tracefile = NULL;
+#endif
+	}
+
+	//
+	// now_ms()
+	//
+	// A monotonic clock, in milliseconds, for timing flushes
+	static	uint64_t	now_ms(void) {
+		struct	timespec	ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+	}
+
+	//
+	// catchsignals(on)
+	//
+	// While a trace is open, or the flight recorder running, catch those
+	// signals that would otherwise kill us with the tail of the trace still
+	// in memory--but only if no one else has claimed them already
+	void	catchsignals(bool on) {
+		const	int	sigs[] = { SIGINT, SIGTERM, SIGHUP };
+
+		if (on == m_sighandlers)
+			return;
+		for(unsigned k=0; k<sizeof(sigs)/sizeof(sigs[0]); k++) {
+			struct	sigaction	sa;
+
+			sigaction(sigs[k], NULL, &sa);
+			if (on && sa.sa_handler == SIG_DFL)
+				signal(sigs[k], testb_trace_sighandler);
+			else if (!on && sa.sa_handler == testb_trace_sighandler)
+				signal(sigs[k], SIG_DFL);
+		}
+		m_sighandlers = on;
+	}
+
+	//
+	// flushcheck()
+	//
+	// Called every TESTB_FLUSH_TICKS ticks while tracing or recording.
+	// Closes the trace, and writes out the flight recorder, if we've been
+	// signaled.  Otherwise flushes the trace if it's been long enough
+	// since the last flush.
+	void	flushcheck(void) {
+		m_flush_countdown = TESTB_FLUSH_TICKS;
+
+		if (testb_trace_signal) {
+			int	sig = testb_trace_signal;
+
+			if (m_flight)
+				failure(strsignal(sig));
+			closetrace();
+			testb_trace_signal = 0;
+			signal(sig, SIG_DFL);
+			raise(sig);
+			return;
+		}
+
+		if (m_trace && now_ms() - m_last_flush_ms >= m_flush_ms)
+			flushtrace();
 	}
 
 	//
@@ -165,6 +900,19 @@ public:
 		m_core->eval();
 	}
 
+	//
+	// dumptrace(time_ps)
+	//
+	// Dump the design's state to the trace, timing it if need be
+	void	dumptrace(uint64_t time_ps) {
+		if (m_profiling) {
+			uint64_t	t0 = profclock();
+			m_trace->dump(time_ps);
+			profadd(TESTB_PROF_TRACE, t0);
+		} else
+			m_trace->dump(time_ps);
+	}
+
 	//
 	// tick()
 	//
@@ -173,42 +921,159 @@ public:
 	// design, this will advance the clocks up until the nearest clock
 	// transition.
 	virtual	void	tick(void) {
+		bool		tracing = false;
+		uint64_t	t0 = 0;
+
+		m_profiling = m_prof_enabled
+			&& (m_tickcount & (TESTB_PROF_INTERVAL-1)) == 0;
+
+#ifndef	TRACE_NONE
+		// Without tracing, tracing stays false, and the compiler can
+		// drop every dumptrace() below
+		if (m_trace) {
+			tracecontrol();
+			tracing = m_trace && !m_paused_trace && !m_trace_gated;
+		}
+#endif
+
+		if (m_flight) {
+			// The flight recorder counts as tracing
+			if (m_profiling) t0 = profclock();
+			m_flight->sample(m_tickcount);
+			if (m_profiling) profadd(TESTB_PROF_TRACE, t0);
+		}
+
+		// The failure expression is checked whenever one is set, with
+		// or without a flight recorder to write out
+		if (!m_failed && m_failtrig.armed()) {
+			if (m_profiling) t0 = profclock();
+			if (m_failtrig())
+				failure("failure expression");
+			if (m_profiling) profadd(TESTB_PROF_TRACE, t0);
+		}
+
 		// Pre-evaluate, to give verilator a chance
 		// to settle any combinatorial logic that
 		// that may have changed since the last clock
 		// evaluation, and then record that in the
 		// trace.
+		if (m_profiling) t0 = profclock();
 		eval();
-		if (m_trace && !m_paused_trace) m_trace->dump(m_time_ps+6944);
+		if (m_profiling) profadd(TESTB_PROF_EVAL, t0);
+		if (tracing) dumptrace(m_time_ps+6944);
 
 		// Advance the one simulation clock, clk
 		m_time_ps+= 13888;
 		m_core->i_clk = 1;
+		if (m_profiling) t0 = profclock();
 		eval();
+		if (m_profiling) profadd(TESTB_PROF_EVAL, t0);
 		// If we are keeping a trace, dump the current state to that
-		// trace now
-		if (m_trace && !m_paused_trace) {
-			m_trace->dump(m_time_ps);
-			m_trace->flush();
-		}
+		// trace now.  It'll be flushed in the background, or every so
+		// often, but never on every tick.
+		if (tracing) dumptrace(m_time_ps);
 
 		// <SINGLE CLOCK ONLY>:
 		// Advance the clock again, so that it has its negative edge
 		m_core->i_clk = 0;
 		m_time_ps+= 13889;
+		if (m_profiling) t0 = profclock();
 		eval();
-		if (m_trace && !m_paused_trace) m_trace->dump(m_time_ps);
+		if (m_profiling) profadd(TESTB_PROF_EVAL, t0);
+		if (tracing) dumptrace(m_time_ps);
+		if ((m_trace || m_flight) && --m_flush_countdown == 0)
+			flushcheck();
+		m_tickcount++;
 
 		// Call to see if any simulation components need
 		// to advance their inputs based upon this clock
+		if (m_profiling) { m_prof_nested = 0; t0 = profclock(); }
 		sim_clk_tick();
+		if (m_profiling) profadd(TESTB_PROF_SIM, t0, m_prof_nested);
+	}
+
+	//
+	// run<TB>(n)
+	//
+	// Advance the simulation by n ticks, exactly as n calls to tick()
+	// would, only faster.  TB is the harness derived from this one
+	// (MAINTB), so that its sim_clk_tick() may be called directly and
+	// inlined, rather than through a virtual function.  The evaluation
+	// before each rising edge is skipped unless a component changed one
+	// of the design's inputs (see setinput()) since the last one.
+	//
+	// While a trace is open, the flight recorder is running, or a failure
+	// expression is set, run() just calls tick().  While profiling, only
+	// the ticks being timed do.
+	// Returns the number of ticks run, which will be fewer than n should
+	// the design $finish, or the simulation fail, first.
+	template<class TB>	uint64_t	run(uint64_t n) {
+		TB		*tb = static_cast<TB *>(this);
+		const	bool	failed = m_failed;
+		uint64_t	k;
+#ifdef	TRACE_NONE
+		const	bool	slow = (m_flight != NULL) || m_failtrig.armed();
+#else
+		const	bool	slow = (m_trace != NULL) || (m_flight != NULL)
+					|| m_failtrig.armed();
+#endif
+
+		if (slow) {
+			for(k=0; k<n; ) {
+				tb->TB::tick();
+				k++;
+				if (done() || (m_failed && !failed))
+					break;
+			} return k;
+		}
+
+		// Any inputs set since the last tick, such as by reset(),
+		// need evaluating first
+		bool	changed = true;
+		for(k=0; k<n; ) {
+			if (m_prof_enabled
+				&& (m_tickcount & (TESTB_PROF_INTERVAL-1)) == 0) {
+				tb->TB::tick();
+				m_profiling = false;
+				changed = true;
+			} else {
+				if (changed)
+					tb->TB::eval();
+				m_core->i_clk = 1;
+				tb->TB::eval();
+				m_core->i_clk = 0;
+				tb->TB::eval();
+				m_time_ps += TESTB_PERIOD_PS;
+				m_tickcount++;
+
+				m_changed = false;
+				tb->TB::sim_clk_tick();
+				changed = m_changed;
+			}
+
+			k++;
+			if (Verilated::gotFinish() || (m_failed && !failed))
+				break;
+		} return k;
+	}
+
+	//
+	// setinput(input, value)
+	//
+	// For the simulation components' @SIM.TICK tags: set one of the
+	// design's inputs, noting in m_changed whether or not it changed.
+	template<class T, class V>	void	setinput(T &input, V value) {
+		m_changed |= (input != (T)value);
+		input = (T)value;
 	}
 
 	virtual	void	sim_clk_tick(void) {
 		// AutoFPGA will override this method within main_tb.cpp if any
 		// @SIM.TICK key is present within a design component also
 		// containing a @SIM.CLOCK key identifying this clock.  That
-		// component must also set m_changed to true.
+		// component must also set m_changed to true should it change
+		// any of the design's inputs, as setinput() does, or run()
+		// won't evaluate that change before the next clock.
 		m_changed = false;
 	}
 	virtual bool	done(void) {
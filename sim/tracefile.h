@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	tracefile.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Moves VCD trace file writes off of the simulation thread.
+//		Verilator formats each trace into a buffer of its own, and then
+//	hands that buffer to a VerilatedVcdFile to be written.  The TRACEFILE
+//	below queues those buffers for a writer thread instead, so that a
+//	traced simulation needn't stop for the disk.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	TRACEFILE_H
+#define	TRACEFILE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <verilated_vcd_c.h>
+
+//
+// TRACEFILE is a VerilatedVcdFile that hands each buffer Verilator gives it to
+// a writer thread, rather than writing it to disk itself.  The simulation
+// only ever waits on the disk if the writer falls more than MAXQUEUED bytes
+// behind.  Pass one to VerilatedVcdC's constructor, and delete it only after
+// the trace has been closed.
+//
+class	TRACEFILE : public VerilatedVcdFile {
+	static	const	size_t	MAXQUEUED = 64ul << 20;
+
+	int			m_fd;
+	bool			m_closing, m_failed;
+	size_t			m_queued;
+	std::deque<std::vector<char> >	m_queue;
+	std::mutex		m_lock;
+	std::condition_variable	m_data, m_space;
+	std::thread		m_writer;
+
+	// writer()
+	// {{{
+	// The writer thread: write out everything queued, in order, until
+	// closed with nothing left to write
+	void	writer(void) {
+		std::unique_lock<std::mutex>	lk(m_lock);
+
+		while(true) {
+			m_data.wait(lk, [this] {
+				return m_closing || !m_queue.empty(); });
+			if (m_queue.empty())
+				break;
+
+			std::vector<char>	buf;
+			buf.swap(m_queue.front());
+			m_queue.pop_front();
+			lk.unlock();
+
+			const char	*ptr = buf.data();
+			size_t		len = buf.size();
+			while(len > 0 && !m_failed) {
+				ssize_t	nw = ::write(m_fd, ptr, len);
+				if (nw < 0) {
+					perror("TRACEFILE::write() ");
+					m_failed = true;
+				} else {
+					ptr += nw;
+					len -= nw;
+				}
+			}
+
+			lk.lock();
+			m_queued -= buf.size();
+			m_space.notify_one();
+		}
+	}
+	// }}}
+public:
+	TRACEFILE(void) : m_fd(-1), m_closing(false), m_failed(false),
+			m_queued(0) {}
+	virtual	~TRACEFILE(void) { close(); }
+
+	virtual	bool	open(const std::string &name) {
+		m_fd = ::open(name.c_str(), O_CREAT|O_WRONLY|O_TRUNC, 0666);
+		if (m_fd < 0)
+			return false;
+		m_closing = false;
+		m_failed  = false;
+		m_writer = std::thread(&TRACEFILE::writer, this);
+		return true;
+	}
+
+	// close()
+	// {{{
+	// Wait for the writer to finish everything queued, then close the file
+	virtual	void	close(void) {
+		if (m_writer.joinable()) {
+			{
+				std::lock_guard<std::mutex>	lk(m_lock);
+				m_closing = true;
+			}
+			m_data.notify_one();
+			m_writer.join();
+		}
+
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+	}
+	// }}}
+
+	// write()
+	// {{{
+	// Called by Verilator with each buffer full of trace.  Copy it, queue
+	// it, and return.
+	virtual	ssize_t	write(const char *bufp, ssize_t len) {
+		std::unique_lock<std::mutex>	lk(m_lock);
+
+		m_space.wait(lk, [this] { return m_queued < MAXQUEUED; });
+		m_queue.push_back(std::vector<char>(bufp, bufp + len));
+		m_queued += len;
+		lk.unlock();
+		m_data.notify_one();
+		return len;
+	}
+	// }}}
+};
+
+#endif	// TRACEFILE_H
@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	tracetrig.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	A trigger for starting a simulation trace, written as an
+//		expression over named probes of the simulation's state.  The
+//	probes are registered by the simulation components themselves (see
+//	the @SIM.INIT tags of the autodata/ files), and the expression is
+//	given on the command line.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	TRACETRIG_H
+#define	TRACETRIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+//
+// TRACETRIGGER holds a set of named probes--functions returning the value of
+// some signal within the simulation--together with an expression over them.
+// The expression is a list of terms, joined by && and ||, with && binding
+// more tightly.  Each term is either a probe name, true when the probe is
+// non-zero, !name, or name OP value with OP one of ==, !=, <, <=, >, or >=.
+// Values may be given in decimal, hex (0x), or octal.  For example,
+//
+//	bomb || uarttx==0 && tick>100000
+//
+class	TRACETRIGGER {
+public:
+	typedef	std::function<uint64_t(void)>	PROBE;
+private:
+	enum	{ OP_NZ, OP_Z, OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE };
+	typedef	struct	{
+		PROBE		probe;
+		int		op;
+		uint64_t	value;
+	} TERM;
+
+	std::map<std::string, PROBE>		m_probes;
+	std::map<std::string, unsigned>		m_widths;
+	// The expression, as an OR of ANDs of terms
+	std::vector<std::vector<TERM> >		m_expr;
+
+	// term()
+	// {{{
+	// Parse one term, from a string with all white space removed
+	bool	term(const std::string &str, TERM &t) {
+		size_t		pos = str.find_first_of("=!<>", 1);
+		std::string	name;
+
+		t.op = OP_NZ;
+		t.value = 0;
+		if (str[0] == '!') {
+			t.op = OP_Z;
+			name = str.substr(1);
+		} else if (pos == std::string::npos) {
+			name = str;
+		} else {
+			const char	*ops = str.c_str() + pos, *vstr;
+			char		*end;
+
+			name = str.substr(0, pos);
+			if (strncmp(ops, "==", 2)==0)      { t.op = OP_EQ; vstr = ops+2; }
+			else if (strncmp(ops, "!=", 2)==0) { t.op = OP_NE; vstr = ops+2; }
+			else if (strncmp(ops, "<=", 2)==0) { t.op = OP_LE; vstr = ops+2; }
+			else if (strncmp(ops, ">=", 2)==0) { t.op = OP_GE; vstr = ops+2; }
+			else if (ops[0] == '<')            { t.op = OP_LT; vstr = ops+1; }
+			else if (ops[0] == '>')            { t.op = OP_GT; vstr = ops+1; }
+			else {
+				fprintf(stderr, "ERR: Unknown operator in %s\n",
+					str.c_str());
+				return false;
+			}
+
+			t.value = strtoull(vstr, &end, 0);
+			if (end == vstr || *end) {
+				fprintf(stderr, "ERR: Bad value in %s\n", str.c_str());
+				return false;
+			}
+		}
+
+		if (m_probes.count(name) == 0) {
+			fprintf(stderr, "ERR: No such probe, %s\n", name.c_str());
+			listprobes(stderr);
+			return false;
+		}
+		t.probe = m_probes[name];
+		return true;
+	}
+	// }}}
+public:
+	// Make a signal, of the given width in bits, available to trigger
+	// expressions
+	void	addprobe(const char *name, PROBE probe, unsigned width = 1) {
+		m_probes[name] = probe;
+		m_widths[name] = width;
+	}
+
+	// Look up a probe, and its width, by name
+	bool	findprobe(const std::string &name, PROBE &probe,
+			unsigned &width) const {
+		auto	it = m_probes.find(name);
+
+		if (it == m_probes.end())
+			return false;
+		probe = it->second;
+		width = m_widths.at(name);
+		return true;
+	}
+
+	// The names of every probe, in alphabetical order
+	std::vector<std::string>	probenames(void) const {
+		std::vector<std::string>	names;
+
+		for(auto it = m_probes.begin(); it != m_probes.end(); it++)
+			names.push_back(it->first);
+		return names;
+	}
+
+	void	listprobes(FILE *fp) const {
+		fprintf(fp, "Trigger probes:");
+		for(auto it = m_probes.begin(); it != m_probes.end(); it++)
+			fprintf(fp, " %s", it->first.c_str());
+		fprintf(fp, "\n");
+	}
+
+	// set(expr)
+	// {{{
+	// Parse a trigger expression.  Returns false, with a message on
+	// stderr, on any error.
+	bool	set(const char *expr) {
+		std::string	str;
+		size_t		start = 0;
+
+		for(const char *ptr = expr; *ptr; ptr++)
+			if (!isspace(*ptr))
+				str += *ptr;
+
+		m_expr.clear();
+		m_expr.push_back(std::vector<TERM>());
+		while(start <= str.size()) {
+			size_t	aand = str.find("&&", start),
+				oor  = str.find("||", start),
+				end  = (aand < oor) ? aand : oor;
+			TERM	t;
+
+			if (end == std::string::npos)
+				end = str.size();
+			if (end == start || !term(str.substr(start, end-start), t)) {
+				if (end == start)
+					fprintf(stderr, "ERR: Missing term in %s\n", expr);
+				m_expr.clear();
+				return false;
+			}
+
+			m_expr.back().push_back(t);
+			if (end == oor)
+				m_expr.push_back(std::vector<TERM>());
+			start = end + 2;
+		}
+
+		return true;
+	}
+	// }}}
+
+	// True if an expression has been set
+	bool	armed(void) const { return !m_expr.empty(); }
+
+	// operator()
+	// {{{
+	// Evaluate the expression
+	bool	operator()(void) const {
+		for(const std::vector<TERM> &conj : m_expr) {
+			bool	v = true;
+
+			for(const TERM &t : conj) {
+				uint64_t	pv = t.probe();
+
+				switch(t.op) {
+				case OP_NZ: v = (pv != 0); break;
+				case OP_Z:  v = (pv == 0); break;
+				case OP_EQ: v = (pv == t.value); break;
+				case OP_NE: v = (pv != t.value); break;
+				case OP_LT: v = (pv <  t.value); break;
+				case OP_LE: v = (pv <= t.value); break;
+				case OP_GT: v = (pv >  t.value); break;
+				case OP_GE: v = (pv >= t.value); break;
+				}
+				if (!v)
+					break;
+			}
+
+			if (v)
+				return true;
+		}
+
+		return false;
+	}
+	// }}}
+};
+
+#endif	// TRACETRIG_H
@@ -6,6 +6,11 @@
 //
 // Purpose:	To forward a Verilator simulated UART link over a TCP/IP pipe.
 //
+//	The simulation side, tick(), only ever shifts bits and, once per byte,
+//	pushes or pops a lock-free queue.  All of the socket work--accepting
+//	connections, reading, and writing--takes place within a separate I/O
+//	thread, which sleeps in poll() until there's something for it to do.
+//
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
 //
@@ -46,6 +51,7 @@
 #include <arpa/inet.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
 
 #include "uartsim.h"
 
@@ -97,22 +103,62 @@ void	UARTSIM::setup_listener(const int port) {
 // {{{
 UARTSIM::UARTSIM(const int port) {
 	m_conrd = m_conwr = m_skt = -1;
+	m_wake[0] = m_wake[1] = -1;
 	if (port == 0) {
 		m_conrd = STDIN_FILENO;
 		m_conwr = STDOUT_FILENO;
-	} else
+	} else if (port > 0)
 		setup_listener(port);
+	m_setup = 0;
 	setup(25);	// Set us up for (default) 8N1 w/ a baud rate of CLK/25
 	m_rx_baudcounter = 0;
 	m_tx_baudcounter = 0;
 	m_rx_state = RXIDLE;
 	m_tx_state = TXIDLE;
+	m_rx_changectr = 0;
+	m_last_tx = 1;
+
+	m_connected = (m_conwr >= 0);
+	m_sleeping  = false;
+	m_stop      = false;
+
+	// With no port at all, there's nothing for an I/O thread to do.  The
+	// device's output is simply dropped, and it never receives anything.
+	if (port < 0)
+		return;
+
+	if (pipe(m_wake) != 0) {
+		perror("ERR: Could not create the I/O thread's pipe: ");
+		exit(EXIT_FAILURE);
+	}
+
+	m_iothread = std::thread(&UARTSIM::ioloop, this);
+}
+// }}}
+
+// UARTSIM::~UARTSIM
+// {{{
+UARTSIM::~UARTSIM(void) {
+	kill();
 }
 // }}}
 
 // UARTSIM::kill
 // {{{
 void	UARTSIM::kill(void) {
+	// Stop the I/O thread first, since it owns the file descriptors
+	if (m_iothread.joinable()) {
+		char	ch = 0;
+
+		m_stop = true;
+		if (write(m_wake[1], &ch, 1) != 1)
+			perror("UARTSIM::kill() ");
+		m_iothread.join();
+		close(m_wake[0]);
+		close(m_wake[1]);
+		m_wake[0] = m_wake[1] = -1;
+	}
+
 	fflush(stdout);
 
 	// Quickly double check that we aren't about to close stdin/stdout
@@ -126,6 +172,7 @@ void	UARTSIM::kill(void) {
 	if (m_skt >= 0) close(m_skt);
 
 	m_conrd = m_conwr = m_skt = -1;
+	m_connected = false;
 }
 // }}}
 
@@ -144,37 +191,269 @@ void	UARTSIM::setup(unsigned isetup) {
 }
 // }}}
 
-// UARTSIM::check_for_new_connections
+// UARTSIM::save(fp)
+// {{{
+// Only the state of the serial line is saved.  Any bytes still queued to or
+// from the network belong to the connection, and so aren't.
+bool	UARTSIM::save(FILE *fp) {
+	int	v[11];
+
+	v[ 0] = (int)m_setup;
+	v[ 1] = m_rx_baudcounter;
+	v[ 2] = m_rx_state;
+	v[ 3] = m_rx_busy;
+	v[ 4] = m_rx_changectr;
+	v[ 5] = m_last_tx;
+	v[ 6] = (int)m_rx_data;
+	v[ 7] = m_tx_baudcounter;
+	v[ 8] = m_tx_state;
+	v[ 9] = m_tx_busy;
+	v[10] = (int)m_tx_data;
+	return fwrite(v, sizeof(v), 1, fp) == 1;
+}
+// }}}
+
+// UARTSIM::restore(fp)
+// {{{
+bool	UARTSIM::restore(FILE *fp) {
+	int	v[11];
+
+	if (fread(v, sizeof(v), 1, fp) != 1)
+		return false;
+	// Force setup() to break the setup register out again
+	m_setup = ~(unsigned)v[0];
+	setup((unsigned)v[0]);
+	m_rx_baudcounter = v[1];
+	m_rx_state       = v[2];
+	m_rx_busy        = v[3];
+	m_rx_changectr   = v[4];
+	m_last_tx        = v[5];
+	m_rx_data        = (unsigned)v[6];
+	m_tx_baudcounter = v[7];
+	m_tx_state       = v[8];
+	m_tx_busy        = v[9];
+	m_tx_data        = (unsigned)v[10];
+	return true;
+}
+// }}}
+
+// UARTSIM::accept_connection
+// {{{
+// Called from the I/O thread, once the listening socket has a connection
+// waiting for us
+void	UARTSIM::accept_connection(void) {
+	const unsigned char	*ptr;
+	unsigned		n;
+	int			fd;
+
+	fd = accept(m_skt, 0, 0);
+	if (fd < 0) {
+		perror("Accept failed:");
+		return;
+	}
+
+	// Anything the device sent while no one was listening is lost, just
+	// as it would've been were the UART a real one
+	while((n = m_toio.avail(&ptr)) > 0)
+		m_toio.consumed(n);
+
+	m_conrd = m_conwr = fd;
+	m_connected = true;
+	// printf("New connection accepted!\n");
+}
+// }}}
+
+// UARTSIM::close_connection
 // {{{
-void	UARTSIM::check_for_new_connections(void) {
-	if ((m_conrd < 0)&&(m_conwr<0)&&(m_skt>=0)) {
-		// Can we accept a connection?
-		struct	pollfd	pb;
-
-		pb.fd = m_skt;
-		pb.events = POLLIN;
-		poll(&pb, 1, 0);
-
-		if (pb.revents & POLLIN) {
-			m_conrd = accept(m_skt, 0, 0);
-			m_conwr = m_conrd;
-
-			if (m_conrd < 0)
-				perror("Accept failed:");
-			// else printf("New connection accepted!\n");
+// Called from the I/O thread, to close the network connection.  Any bytes
+// still waiting to be sent over it are dropped.
+void	UARTSIM::close_connection(const char *why) {
+	const unsigned char	*ptr;
+	unsigned		n;
+
+	if (why)
+		fprintf(stderr, "%s\n", why);
+	m_connected = false;
+	close(m_conrd);
+	m_conrd = m_conwr = -1;
+
+	while((n = m_toio.avail(&ptr)) > 0)
+		m_toio.consumed(n);
+}
+// }}}
+
+// UARTSIM::ioloop
+// {{{
+// The I/O thread.  It sleeps in poll() until either the connection (or the
+// listening socket) needs attention, or the simulation wakes it with new
+// bytes to send.
+void	UARTSIM::ioloop(void) {
+	const bool	network = (m_skt >= 0);
+
+	while(!m_stop) {
+		struct	pollfd	pb[4];
+		int		npb = 0, iskt = -1, ird = -1, iwr = -1, timeout;
+
+		pb[npb].fd = m_wake[0];
+		pb[npb].events = POLLIN;
+		npb++;
+
+		if ((network)&&(m_conrd < 0)&&(m_conwr < 0)) {
+			iskt = npb;
+			pb[npb].fd = m_skt;
+			pb[npb].events = POLLIN;
+			npb++;
+		}
+
+		if ((m_conrd >= 0)&&(!m_fromio.full())) {
+			ird = npb;
+			pb[npb].fd = m_conrd;
+			pb[npb].events = POLLIN;
+			npb++;
+		}
+
+		// Announce that we might be sleeping before the last check for
+		// anything to send, so that send_byte() either sees us
+		// sleeping, or we see its byte
+		m_sleeping = true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if ((m_conwr >= 0)&&(!m_toio.empty())) {
+			if (m_conwr == m_conrd && ird >= 0) {
+				iwr = ird;
+				pb[iwr].events |= POLLOUT;
+			} else {
+				iwr = npb;
+				pb[npb].fd = m_conwr;
+				pb[npb].events = POLLOUT;
+				npb++;
+			}
+		}
+
+		// If the simulation hasn't yet caught up with what we've read,
+		// we won't hear when it does, so check back again shortly
+		timeout = ((m_conrd >= 0)&&(ird < 0)) ? 1 : -1;
+
+		if (poll(pb, npb, timeout) < 0) {
+			m_sleeping = false;
+			if (errno != EINTR)
+				perror("Polling error:");
+			continue;
+		}
+		m_sleeping = false;
+
+		if (pb[0].revents & POLLIN) {
+			char	buf[64];
+
+			if (read(m_wake[0], buf, sizeof(buf)) < 0)
+				perror("UARTSIM wake read: ");
+		}
+
+		if ((iskt >= 0)&&(pb[iskt].revents & POLLIN))
+			accept_connection();
+
+		if ((ird >= 0)&&(pb[ird].revents & (POLLIN|POLLHUP|POLLERR))) {
+			// {{{
+			unsigned char	*ptr;
+			unsigned	room = m_fromio.space(&ptr);
+			ssize_t		nr;
+
+			if (network)
+				nr = recv(m_conrd, ptr, room, MSG_DONTWAIT);
+			else
+				nr = read(m_conrd, ptr, room);
+
+			if (nr > 0)
+				m_fromio.produced(nr);
+			else if (nr == 0) {
+				if (network)
+					close_connection(NULL);
+					// printf("Closing network connection\n");
+				else	// End of file: there's no more to read
+					m_conrd = -1;
+			} else if ((errno != EAGAIN)&&(errno != EINTR)) {
+				if (!network) {
+					fprintf(stderr, "ERR while attempting to read in--closing input port\n");
+					perror("UARTSIM::read() ");
+					m_conrd = -1;
+				} else {
+					perror("O/S Read err:");
+					close_connection(NULL);
+				}
+			}
+			// }}}
+		}
+
+		if ((iwr >= 0)&&(m_conwr >= 0)
+				&&(pb[iwr].revents & (POLLOUT|POLLHUP|POLLERR))) {
+			// {{{
+			const unsigned char	*ptr;
+			unsigned	n = m_toio.avail(&ptr);
+			ssize_t		nw;
+
+			if (network)
+				nw = send(m_conwr, ptr, n, MSG_DONTWAIT);
+			else
+				nw = write(m_conwr, ptr, n);
+
+			if (nw > 0)
+				m_toio.consumed(nw);
+			else if ((nw < 0)&&(errno != EAGAIN)&&(errno != EINTR)) {
+				if (network)
+					close_connection("Failed write, connection closed");
+				else {
+					fprintf(stderr, "ERR while attempting to write out--closing output port\n");
+					perror("UARTSIM::write() ");
+					m_connected = false;
+					m_conrd = m_conwr = -1;
+				}
+			}
+			// }}}
 		}
 	}
 
+	// Before we go, send anything the device has left for us
+	if (m_conwr >= 0) {
+		const unsigned char	*ptr;
+		unsigned	n;
+
+		while((n = m_toio.avail(&ptr)) > 0) {
+			ssize_t	nw = write(m_conwr, ptr, n);
+			if (nw <= 0)
+				break;
+			m_toio.consumed(nw);
+		}
+	}
 }
 // }}}
 
-// UARTSIM::rawtick(i_tx, network)
+// UARTSIM::send_byte
 // {{{
-int	UARTSIM::rawtick(const int i_tx, const bool network) {
-	int	o_rx = 1, nr = 0;
+// Called from the simulation, with each byte received from the device
+void	UARTSIM::send_byte(unsigned char ch) {
+	// Much like a blocking write, wait on the I/O thread should we ever
+	// get so far ahead of it as to fill the queue
+	while(!m_toio.push(ch)) {
+		if (!m_connected.load(std::memory_order_relaxed))
+			return;
+		std::this_thread::yield();
+	}
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed)
+			&& m_sleeping.exchange(false)) {
+		char	wake = 0;
+
+		if (write(m_wake[1], &wake, 1) != 1)
+			perror("UARTSIM wake: ");
+	}
+}
+// }}}
 
-	if (network)
-		check_for_new_connections();
+// UARTSIM::tick(i_tx)
+// {{{
+int	UARTSIM::tick(const int i_tx) {
+	int		o_rx = 1;
+	unsigned char	ch;
 
 	if ((!i_tx)&&(m_last_tx))
 		m_rx_changectr = 0;
@@ -192,19 +471,8 @@ int	UARTSIM::rawtick(const int i_tx, const bool network) {
 	} else if (m_rx_baudcounter <= 0) {
 		if (m_rx_busy >= (1<<(m_nbits+m_nparity+m_nstop-1))) {
 			m_rx_state = RXIDLE;
-			if (m_conwr >= 0) {
-				char	buf[1];
-				buf[0] = (m_rx_data >> (32-m_nbits-m_nstop-m_nparity))&0x0ff;
-				if ((network)&&(1 != send(m_conwr, buf, 1, 0))) {
-					close(m_conwr);
-					m_conrd = m_conwr = -1;
-					fprintf(stderr, "Failed write, connection closed\n");
-				} else if ((!network)&&(1 != write(m_conwr, buf, 1))) {
-					fprintf(stderr, "ERR while attempting to write out--closing output port\n");
-					perror("UARTSIM::write() ");
-					m_conrd = m_conwr = -1;
-				}
-			}
+			if (m_connected.load(std::memory_order_relaxed))
+				send_byte((m_rx_data >> (32-m_nbits-m_nstop-m_nparity))&0x0ff);
 		} else {
 			m_rx_busy = (m_rx_busy << 1)|1;
 			// Low order bit is transmitted first, in this
@@ -223,60 +491,32 @@ int	UARTSIM::rawtick(const int i_tx, const bool network) {
 	} else
 		m_rx_baudcounter--;
 
-	if ((m_tx_state == TXIDLE)&&((network)||(m_conrd >= 0))) {
-		struct	pollfd	pb;
-		pb.fd = m_conrd;
-		pb.events = POLLIN;
-		if (poll(&pb, 1, 0) < 0)
-			perror("Polling error:");
-
-		if (pb.revents & POLLIN) {
-			char	buf[1];
+	if (m_tx_state == TXIDLE) {
+		if (m_fromio.pop(ch)) {
+			m_tx_data = (-1<<(m_nbits+m_nparity+1))
+				// << nstart_bits
+				|((ch<<1)&0x01fe);
+			if (m_nparity) {
+				int	p;
 
-			if (network)
-				nr = recv(m_conrd, buf, 1, MSG_DONTWAIT);
-			else
-				nr = read(m_conrd, buf, 1);
-			if (1 == nr) {
-				m_tx_data = (-1<<(m_nbits+m_nparity+1))
-					// << nstart_bits
-					|((buf[0]<<1)&0x01fe);
-				if (m_nparity) {
-					int	p;
-
-					// If m_nparity is set, we need to then
-					// create the parity bit.
-					if (m_fixdp)
-						p = m_evenp;
-					else {
-						p = (m_tx_data >> 1)&0x0ff;
-						p = p ^ (p>>4);
-						p = p ^ (p>>2);
-						p = p ^ (p>>1);
-						p &= 1;
-						p ^= m_evenp;
-					}
-					m_tx_data |= (p<<(m_nbits+m_nparity));
-				}
-				m_tx_busy = (1<<(m_nbits+m_nparity+m_nstop+1))-1;
-				m_tx_state = TXDATA;
-				o_rx = 0;
-				m_tx_baudcounter = m_baud_counts-1;
-			} else if ((network)&&(nr == 0)) {
-				close(m_conrd);
-				m_conrd = m_conwr = -1;
-				// printf("Closing network connection\n");
-			} else if (nr < 0) {
-				if (!network) {
-					fprintf(stderr, "ERR while attempting to read in--closing input port\n");
-					perror("UARTSIM::read() ");
-					m_conrd = -1;
-				} else {
-					perror("O/S Read err:");
-					close(m_conrd);
-					m_conrd = m_conwr = -1;
+				// If m_nparity is set, we need to then
+				// create the parity bit.
+				if (m_fixdp)
+					p = m_evenp;
+				else {
+					p = (m_tx_data >> 1)&0x0ff;
+					p = p ^ (p>>4);
+					p = p ^ (p>>2);
+					p = p ^ (p>>1);
+					p &= 1;
+					p ^= m_evenp;
 				}
+				m_tx_data |= (p<<(m_nbits+m_nparity));
 			}
+			m_tx_busy = (1<<(m_nbits+m_nparity+m_nstop+1))-1;
+			m_tx_state = TXDATA;
+			o_rx = 0;
+			m_tx_baudcounter = m_baud_counts-1;
 		}
 	} else if (m_tx_baudcounter <= 0) {
 		m_tx_data >>= 1;
@@ -294,17 +534,3 @@ int	UARTSIM::rawtick(const int i_tx, const bool network) {
 	return o_rx;
 }
 // }}}
-
-// UARTSIM::nettick
-// {{{
-int	UARTSIM::nettick(const int i_tx) {
-	return rawtick(i_tx, true);
-}
-// }}}
-
-// UARTSIM::fdtick
-// {{{
-int	UARTSIM::fdtick(const int i_tx) {
-	return rawtick(i_tx, false);
-}
-// }}}
@@ -9,6 +9,12 @@
 //	This file provides the description of the interface between the UARTSIM
 //	and the rest of the world.  See below for more detailed descriptions.
 //
+//	The sockets (or file descriptors) are owned by a background I/O
+//	thread, which exchanges bytes with the simulation through a pair of
+//	single producer, single consumer queues.  The simulation's per-clock
+//	tick therefore makes no system calls, and touches the queues only at
+//	byte boundaries.
+//
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
 //
@@ -51,20 +57,110 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <atomic>
+#include <thread>
 
 #define	TXIDLE	0
 #define	TXDATA	1
 #define	RXIDLE	0
 #define	RXDATA	1
 
+// UARTQUEUE
+// {{{
+// A lock-free byte queue, between exactly one producer thread and one consumer
+// thread.  Besides single bytes, either side may also ask for the largest
+// contiguous piece of the buffer it may use, so that the I/O thread can
+// read() into, or write() from, the queue directly.
+class	UARTQUEUE {
+public:
+	static	const	unsigned	LGSIZE = 12, SIZE = (1u<<LGSIZE),
+					MASK = SIZE-1;
+private:
+	// m_head is only ever written by the producer, m_tail by the consumer
+	alignas(64) std::atomic<unsigned>	m_head;
+	alignas(64) std::atomic<unsigned>	m_tail;
+	unsigned char	m_buf[SIZE];
+public:
+	UARTQUEUE(void) : m_head(0), m_tail(0) {}
+
+	unsigned	count(void) const {
+		return m_head.load(std::memory_order_acquire)
+			- m_tail.load(std::memory_order_acquire); }
+	bool	empty(void) const { return count() == 0; }
+	bool	full(void) const { return count() >= SIZE; }
+
+	// Producer side
+	// {{{
+	bool	push(unsigned char ch) {
+		unsigned	h = m_head.load(std::memory_order_relaxed);
+
+		if (h - m_tail.load(std::memory_order_acquire) >= SIZE)
+			return false;
+		m_buf[h & MASK] = ch;
+		m_head.store(h+1, std::memory_order_release);
+		return true;
+	}
+
+	// The contiguous space available for writing, at *ptr
+	unsigned	space(unsigned char **ptr) {
+		unsigned	h = m_head.load(std::memory_order_relaxed),
+				room = SIZE - (h - m_tail.load(
+						std::memory_order_acquire));
+
+		*ptr = &m_buf[h & MASK];
+		if (room > SIZE - (h & MASK))
+			room = SIZE - (h & MASK);
+		return room;
+	}
+
+	// Commit n bytes, written into the space returned by space()
+	void	produced(unsigned n) {
+		m_head.store(m_head.load(std::memory_order_relaxed) + n,
+			std::memory_order_release);
+	}
+	// }}}
+
+	// Consumer side
+	// {{{
+	bool	pop(unsigned char &ch) {
+		unsigned	t = m_tail.load(std::memory_order_relaxed);
+
+		if (t == m_head.load(std::memory_order_acquire))
+			return false;
+		ch = m_buf[t & MASK];
+		m_tail.store(t+1, std::memory_order_release);
+		return true;
+	}
+
+	// The contiguous data available for reading, at *ptr
+	unsigned	avail(const unsigned char **ptr) const {
+		unsigned	t = m_tail.load(std::memory_order_relaxed),
+				n = m_head.load(std::memory_order_acquire) - t;
+
+		*ptr = &m_buf[t & MASK];
+		if (n > SIZE - (t & MASK))
+			n = SIZE - (t & MASK);
+		return n;
+	}
+
+	// Release n bytes, read from the data returned by avail()
+	void	consumed(unsigned n) {
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + n,
+			std::memory_order_release);
+	}
+	// }}}
+};
+// }}}
+
 class	UARTSIM	{
 	// Member declarations
 	// {{{
-	// The file descriptors:
+	// The file descriptors, all owned by the I/O thread once started:
 	//	m_skt   is the socket/port we are listening on
 	//	m_conrd is the file descriptor to read from
 	//	m_conwr is the file descriptor to write to
-	int	m_skt, m_conrd, m_conwr;
+	//	m_wake  is a pipe, used to wake the I/O thread
+	int	m_skt, m_conrd, m_conwr, m_wake[2];
 	//
 	// The m_setup register is the 29'bit control register used within
 	// the core.
@@ -77,6 +173,16 @@ class	UARTSIM	{
 		m_rx_changectr, m_last_tx;
 	int	m_tx_baudcounter, m_tx_state, m_tx_busy;
 	unsigned	m_rx_data, m_tx_data;
+
+	// The I/O thread, and the queues between it and the simulation.
+	//	m_toio   holds bytes received from the device, to be written
+	//	m_fromio holds bytes read from the connection, for the device
+	std::thread		m_iothread;
+	UARTQUEUE		m_toio, m_fromio;
+	// m_connected is true whenever there's somewhere for m_toio's bytes to
+	// go.  m_sleeping is true while the I/O thread may be blocked within
+	// poll(), and so needs waking to notice new bytes in m_toio.
+	std::atomic<bool>	m_connected, m_sleeping, m_stop;
 	// }}}
 
 	// Private methods
@@ -85,22 +191,17 @@ class	UARTSIM	{
 	// related setup stuff.
 	void	setup_listener(const int port);
 
-	// Call check_for_new_connections() to see if we can accept a new
-	// network socket connection to our device
-	void	check_for_new_connections(void);
-
-	// nettick() gets called if we are connected to a network, and
-	int	nettick(const int i_tx);
-	int	fdtick(const int i_tx);
-	int	rawtick(const int i_tx, const bool network);
-
-	// We'll use the file descriptor for the listener socket to determine
-	// whether we are connected to the network or not.  If not connected
-	// to the network, then we assume m_conrd and m_conwr refer to 
-	// your more traditional file descriptors, and use them as such.
-	int	tick(const int i_tx) {
-		return rawtick(i_tx, (m_skt >= 0));
-	}
+	// The I/O thread's main loop, and its helpers
+	void	ioloop(void);
+	void	accept_connection(void);
+	void	close_connection(const char *why);
+
+	// Hand a byte, received from the device, to the I/O thread
+	void	send_byte(unsigned char ch);
+
+	// tick() is called once per simulation clock.  It makes no system
+	// calls, and so never needs to wait on the network.
+	int	tick(const int i_tx);
 	// }}}
 public:
 	// Public member functions
@@ -110,14 +211,18 @@ public:
 	// {{{
 	// The UARTSIM constructor takes one argument: the port on the
 	// localhost to listen in on.  Once started, connections may be made
-	// to this port to get the output from the port.
+	// to this port to get the output from the port.  A port of zero
+	// uses the standard input and output instead, and a negative port
+	// connects the UART to nothing at all.
 	UARTSIM(const int port);
+	~UARTSIM(void);
 	// }}}
 
 	// kill(void)
 	// {{{
-	// kill() closes any active connection and the socket.  Once killed,
-	// no further output will be sent to the port.
+	// kill() stops the I/O thread, and then closes any active connection
+	// and the socket.  Once killed, no further output will be sent to the
+	// port.
 	void	kill(void);
 	// }}}
 
@@ -129,6 +234,14 @@ public:
 	void	setup(unsigned isetup);
 	// }}}
 
+	// save(fp), restore(fp)
+	// {{{
+	// Save the state of the serial line to a (checkpoint) file, or
+	// restore it from one.  Both return false on any I/O error.
+	bool	save(FILE *fp);
+	bool	restore(FILE *fp);
+	// }}}
+
 	// operator()(i_tx)
 	// {{{
 	// The operator() function is called on every tick.  The input is the
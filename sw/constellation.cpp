@@ -4,7 +4,19 @@
 // {{{
 // Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
 //
-// Purpose:	
+// Purpose:	Reads the 32x32 constellation histogram from the histogram
+//		core, and draws it as a density plot.  The top five bits of
+//	each bin's index are the in-phase sample, and the bottom five the
+//	quadrature sample, both in two's complement, so the plot is drawn with
+//	I running from -16 on the left to +15 on the right, and Q from +15 at
+//	the top down to -16.  Since a good constellation concentrates nearly
+//	all of its counts within a handful of bins, the shading is logarithmic
+//	in the count.
+//
+//	In continuous (-m) mode, a new frame is read every histogram interrupt,
+//	up to the given rate, over the one connection, and only the rows that
+//	have changed are redrawn--all with a single write per frame.
+//
 //
 // Creator:	Dan Gisselquist, Ph.D.
 //		Gisselquist Technology, LLC
@@ -37,92 +49,393 @@
 // }}}
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <strings.h>
 #include <ctype.h>
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <math.h>
 
 #include "port.h"
 #include "regdefs.h"
 #include "hexbus.h"
+#include "histstats.h"
+#include "histarchive.h"
+#include "histread.h"
+
+#define	NBINS		HISTREAD_NBINS
+#define	CWIDTH		32	// Bins along each axis
+#define	CHALF		(CWIDTH/2)
+// Each row is drawn as a "%+4d " label, two characters per bin, and an
+// axis marker
+#define	ROWLEN		(5+2*CWIDTH+3)
+// The status lines, above the plot
+#define	NSTATUS		2
+
+// Shading, from empty to the most counts, on a log scale
+static const char	RAMP[] = " .:-=+*#%@";
+#define	NRAMP		((int)sizeof(RAMP)-1)
 
 FPGA	*m_fpga;
+HISTREADER	*m_reader;
+volatile bool	m_done = false;
+FILE		*m_statsfp = NULL;
+HISTARCHIVE	*m_archive = NULL;
+HARC_RECORD	m_ident;	// Design identity, common to all archive records
+
 void	closeup(int v) {
 	m_fpga->kill();
 	exit(0);
 }
 
+void	stopmonitor(int v) {
+	m_done = true;
+}
+
 void	usage(void) {
-	printf("USAGE: constellation\n");
+	printf(
+"USAGE: constellation [-n host] [-p port] [-f] [-s file] [-o file] [-m]\n"
+"\t\t[-r rate] [-c count]\n"
+"\n"
+"\t-n host\tThe network host name of the bus server [%s]\n"
+"\t-p port\tThe network port of the bus server [%d]\n"
+"\n"
+"\tWith no further options, the constellation is read once, drawn, and\n"
+"\twritten to cons.bin.\n"
+"\n"
+"\t-f\tRead every bin, rather than only the blocks of bins that the\n"
+"\t\thistogram's occupancy map reports as holding counts\n"
+"\t-s file\tAppend the constellation's statistics, one line of JSON per\n"
+"\t\tframe, to file.  Use - for the standard output.\n"
+"\t-o file\tAppend every constellation, together with its timestamp, tap\n"
+"\t\tselection and the design's build time and version, to the\n"
+"\t\tframe archive, file\n"
+"\t-m\tMonitor the constellation, redrawing it as each new frame\n"
+"\t\tarrives\n"
+"\t-r rate\tMaximum number of frames per second to read in monitor\n"
+"\t\tmode [default: 5]\n"
+"\t-c count\tStop after count frames.  The default is to run until\n"
+"\t\tinterrupted with a ^C\n", FPGAHOST, FPGAPORT);
 }
 
-int main(int argc, char **argv) {
-	const char *host = FPGAHOST;
-	int	port=FPGAPORT;
-	unsigned	hbuf[1024];
-	int	x, y;
-	int	con[32][32];
+// conbin
+// {{{
+// The bin holding the counts for the (signed) sample pair (i, q)
+static inline unsigned	conbin(const unsigned *hbuf, int i, int q) {
+	return hbuf[((i & 0x1f) << 5) | (q & 0x1f)];
+}
+// }}}
 
+// drawrow
+// {{{
+// Draw the row of the plot for quadrature value q into buf, which must hold
+// at least ROWLEN+1 characters.  lmax is log(max+1), for the largest bin
+// count max in the frame.
+void	drawrow(char *buf, const unsigned *hbuf, int q, double lmax) {
+	char	*ptr = buf;
 
-	m_fpga = new FPGA(new NETCOMMS(host, port));
+	ptr += sprintf(ptr, "%+4d ", q);
+	for(int i=-CHALF; i<CHALF; i++) {
+		unsigned	c = conbin(hbuf, i, q);
+		char		ch;
 
-	signal(SIGSTOP, closeup);
-	signal(SIGHUP, closeup);
+		if (c == 0) {
+			// Draw the axes through any empty bins
+			ch = (i == 0 && q == 0) ? '+'
+				: (i == 0) ? '|' : (q == 0) ? '-' : ' ';
+		} else {
+			int	lvl;
 
-	m_fpga->readi(R_HISTOGRAM, 1024, hbuf);
+			lvl = 1 + (int)((NRAMP-2) * log(c + 1.0) / lmax + 0.5);
+			if (lvl >= NRAMP)
+				lvl = NRAMP-1;
+			ch = RAMP[lvl];
+		}
+		*ptr++ = ch;
+		*ptr++ = ch;
+	}
+	sprintf(ptr, (q == 0) ? " --" : "   ");
+}
+// }}}
 
-	for(int k=0; k<1024; k++) {
-		x = (k>>5) & 0x1f;
-		y = k & 0x1f;
+// iaxis
+// {{{
+// The in-phase axis labels, beneath the plot
+int	iaxis(char *buf) {
+	return sprintf(buf, "     %-*d%-*d%d", CWIDTH, -CHALF,
+			CWIDTH-2, 0, CHALF-1);
+}
+// }}}
+
+// lnmax
+// {{{
+// log(max+1), for the largest bin count within the frame, as used to scale
+// the shading
+double	lnmax(const unsigned *hbuf) {
+	unsigned	mx = 0;
+
+	for(int k=0; k<NBINS; k++)
+		if (hbuf[k] > mx)
+			mx = hbuf[k];
+	return log(mx + 1.0);
+}
+// }}}
 
-		con[y][x] = hbuf[k];
+// frame_stats
+// {{{
+// Compute (and log) the statistics of a frame, returning them within st
+void	frame_stats(const unsigned *hbuf, uint64_t tstamp, CONSTATS &st) {
+	constats(hbuf, st);
+	if (m_statsfp) {
+		constats_json(m_statsfp, st, tstamp);
+		fflush(m_statsfp);
 	}
+}
+// }}}
 
-	for(int y=0; y<0x20; y++) {
-		// {{{
-		int	cy = y - 0x10;
+// archive_frame
+// {{{
+// Append a frame to the archive, if we have one
+void	archive_frame(const unsigned *hbuf, unsigned flags, uint64_t tstamp) {
+	HARC_RECORD	rec;
 
-		if (cy == 0)
-			printf("-- ");
-		else
-			printf("   ");
-
-		for(int x=0; x<0x20; x++) {
-			int	cx = x - 0x10, cp;
-
-			cp = con[cy][cx];
-			if (cp == 0)
-				printf(" ");
-			else if (cp > 16)
-				printf("X");
-			else if (cp > 8)
-				printf("x");
-			else if (cp > 4)
-				printf("o");
-			else if (cp > 2)
-				printf("*");
-			else
-				printf(".");
-		}
+	if (NULL == m_archive)
+		return;
 
-		if (cy == 0)
-			printf("-- ");
-		else
-			printf("   ");
+	rec = m_ident;
+	rec.kind      = HARC_CONSTELLATION;
+	rec.tstamp_us = tstamp;
+	rec.flags     = flags;
+	rec.gpio      = m_fpga->readio(R_GPIO);
+	rec.tap       = HARC_TAP(rec.gpio);
+	if (!m_archive->append(rec, hbuf)) {
+		delete m_archive;
+		m_archive = NULL;
+	}
+}
+// }}}
 
-		printf("\n");
-		// }}}
+// snapshot
+// {{{
+// Read and draw a single constellation, and save it to cons.bin
+void	snapshot(void) {
+	unsigned	hbuf[NBINS];
+	char		*buf, *ptr;
+	double		lmax;
+	uint64_t	tstamp;
+	CONSTATS	st;
+	FILE		*hp;
+
+	// Read what's there now, rather than waiting on the next frame
+	m_reader->read_bins(hbuf);
+	tstamp = wallclock_us();
+
+	buf = new char[(CWIDTH+1) * (ROWLEN+1) + 1];
+	ptr = buf;
+	lmax = lnmax(hbuf);
+	for(int q=CHALF-1; q >= -CHALF; q--) {
+		drawrow(ptr, hbuf, q, lmax);
+		ptr += strlen(ptr);
+		*ptr++ = '\n';
 	}
+	ptr += iaxis(ptr);
+	*ptr++ = '\n';
+	fwrite(buf, 1, ptr-buf, stdout);
+	delete[] buf;
 
-	FILE	*hp;
 	hp = fopen("cons.bin","w");
-	fwrite(hbuf, sizeof(int), 1024, hp);
+	fwrite(hbuf, sizeof(int), NBINS, hp);
 	fclose(hp);
 
-	if (m_fpga->poll())
-		printf("FPGA was interrupted\n");
-	delete	m_fpga;
+	frame_stats(hbuf, tstamp, st);
+	archive_frame(hbuf, 0, tstamp);
 }
+// }}}
 
+// monitor
+// {{{
+// Repeatedly read the constellation, once per histogram interrupt but no more
+// than rate times per second.  Each frame is rendered into a single buffer,
+// holding only those rows that differ from what's already on the screen, and
+// then written out at once.
+void	monitor(double rate, unsigned count) {
+	unsigned	hbuf[NBINS];
+	char		(*shown)[ROWLEN+1], row[ROWLEN+1], *buf, *ptr;
+	uint64_t	interval_ms, next_ms;
+	unsigned	frame = 0;
+
+	shown = new char[CWIDTH][ROWLEN+1];
+	memset(shown, 0, CWIDTH * (ROWLEN+1));
+	// Cursor moves, the status lines, and every row, with room to spare
+	buf = new char[(CWIDTH+NSTATUS+2) * (ROWLEN+32) + 256];
+
+	interval_ms = (rate > 0) ? (uint64_t)(1000.0 / rate) : 0;
+
+	// Clear the screen, hide the cursor, and draw the I axis labels
+	ptr = buf;
+	ptr += sprintf(ptr, "\033[2J\033[?25l\033[%d;1H", NSTATUS+CWIDTH+2);
+	ptr += iaxis(ptr);
+	fwrite(buf, 1, ptr-buf, stdout);
+	fflush(stdout);
+
+	next_ms = monotonic_ms();
+	while(!m_done && (count == 0 || frame < count)) {
+		unsigned	fflags, nrows = 0;
+		uint64_t	tstamp;
+		double		lmax;
+		CONSTATS	st;
+
+		// Rate limit: sleep on the bus, rather than the host, so that
+		// any bus traffic keeps getting processed
+		while(!m_done && monotonic_ms() < next_ms)
+			m_fpga->usleep((unsigned)(next_ms - monotonic_ms()));
+		if (m_done)
+			break;
+		next_ms += interval_ms;
+		if (next_ms < monotonic_ms())
+			next_ms = monotonic_ms();
+
+		fflags = m_reader->read_frame(hbuf, &tstamp);
+		if (m_done)
+			break;
+
+		frame_stats(hbuf, tstamp, st);
+
+		ptr = buf;
+		lmax = lnmax(hbuf);
+		for(int r=0; r<CWIDTH; r++) {
+			drawrow(row, hbuf, CHALF-1-r, lmax);
+			if (0 == strcmp(row, shown[r]))
+				continue;
+			strcpy(shown[r], row);
+			ptr += sprintf(ptr, "\033[%d;1H%s", NSTATUS+1+r, row);
+			nrows++;
+		}
+
+		ptr += sprintf(ptr, "\033[1;1HFrame %6u  Counts %10lu  Peak %8.0f  Read %4u  Rows %2u%s\033[K",
+			frame, (unsigned long)st.total, exp(lmax)-1.0,
+			m_reader->words_read(), nrows,
+			(fflags & HISTF_TIMEOUT) ? "  (no interrupt)"
+			: (fflags & HISTF_TORN) ? "  (torn)" : "");
+		if (st.total > 0)
+			ptr += sprintf(ptr, "\033[2;1HEVM %6.2f%%  MER %6.2f dB  Amplitude %5.2f  Mean (%+5.2f,%+5.2f)  Clipped %6.2f%%\033[K",
+				st.evm_pct, st.mer_db, st.amplitude,
+				st.mean_i, st.mean_q, 100.0 * st.clipped);
+		else
+			ptr += sprintf(ptr, "\033[2;1H\033[K");
+		ptr += sprintf(ptr, "\033[%d;1H", NSTATUS+CWIDTH+3);
+
+		fwrite(buf, 1, ptr-buf, stdout);
+		fflush(stdout);
+
+		archive_frame(hbuf, fflags, tstamp);
+		frame++;
+	}
+
+	// Restore the cursor
+	printf("\033[%d;1H\033[?25h\n", NSTATUS+CWIDTH+3);
+	fflush(stdout);
+
+	delete[] shown;
+	delete[] buf;
+}
+// }}}
+
+int main(int argc, char **argv) {
+	int	skp=0;
+	const char *host = FPGAHOST, *stats_fname = NULL,
+			*archive_fname = NULL;
+	int	port=FPGAPORT;
+	bool	monitor_flag = false, sparse = true;
+	double	rate = 5.0;
+	unsigned count = 0;
+
+	// Argument processing
+	// {{{
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 'm') {
+				monitor_flag = true;
+			} else if (argv[argn+skp][1] == 'f') {
+				sparse = false;
+			} else if (argv[argn+skp][1]
+					&& strchr("nprcso", argv[argn+skp][1])) {
+				char	opt = argv[argn+skp][1];
+
+				if (argn+skp+1 >= argc) {
+					fprintf(stderr, "ERR: No argument given to -%c\n", opt);
+					exit(EXIT_FAILURE);
+				}
+
+				const char *val = argv[argn+skp+1];
+				if (opt == 'n')
+					host = val;
+				else if (opt == 'p')
+					port = strtoul(val, NULL, 0);
+				else if (opt == 'r')
+					rate = atof(val);
+				else if (opt == 'c')
+					count = strtoul(val, NULL, 0);
+				else if (opt == 's')
+					stats_fname = val;
+				else // if (opt == 'o')
+					archive_fname = val;
+				skp++;	// The option's value
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+	// }}}
+
+	if (archive_fname) {
+		m_archive = new HISTARCHIVE();
+		if (!m_archive->open(archive_fname, true, NBINS))
+			exit(EXIT_FAILURE);
+	}
+
+	if (stats_fname) {
+		if (0 == strcmp(stats_fname, "-"))
+			m_statsfp = stdout;
+		else if (NULL == (m_statsfp = fopen(stats_fname, "a"))) {
+			fprintf(stderr, "ERR: Could not open %s\n", stats_fname);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	m_fpga = new FPGA(new NETCOMMS(host, port));
+	m_reader = new HISTREADER(m_fpga);
+	m_reader->set_sparse(sparse);
+	m_reader->set_abort(&m_done);
+
+	signal(SIGSTOP, closeup);
+	signal(SIGHUP, closeup);
+
+	if (m_archive) {
+		memset(&m_ident, 0, sizeof(m_ident));
+		m_ident.buildtime = m_fpga->readio(R_BUILDTIME);
+		m_ident.version   = m_fpga->readio(R_VERSION);
+	}
+
+	if (monitor_flag) {
+		signal(SIGINT, stopmonitor);
+		signal(SIGTERM, stopmonitor);
+		monitor(rate, count);
+	} else {
+		snapshot();
+		if (m_fpga->poll())
+			printf("FPGA was interrupted\n");
+	}
+
+	if (m_statsfp && m_statsfp != stdout)
+		fclose(m_statsfp);
+	delete	m_archive;
+	delete	m_reader;
+	delete	m_fpga;
+}
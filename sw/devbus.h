@@ -132,6 +132,31 @@ public:
 	virtual	void	writez(const BUSW a, const int len, const BUSW *buf)= 0;
 	// }}}
 
+	// xferz: A mixed series of writes and reads, all to the same address
+	// {{{
+	//	a is the address of the value to be written or read
+	//	len is the number of operations, reads and writes together
+	//	rd[i] is true if the i'th operation is a read, false if a write
+	//	wbuf[i] is the value to write for each write (ignored for reads)
+	//	rbuf receives the values read, in order, one per read
+	// This is equivalent to:
+	//	for(int i=0, nr=0; i<len; i++)
+	//		if (rd[i])
+	//			rbuf[nr++] = readio(a);
+	//		else
+	//			writeio(a, wbuf[i]);
+	// which is also how it's done here.  Interfaces that can send the
+	// whole series before collecting the responses should do so.
+	virtual	void	xferz(const BUSW a, const int len, const bool *rd,
+				const BUSW *wbuf, BUSW *rbuf) {
+		for(int i=0, nr=0; i<len; i++)
+			if (rd[i])
+				rbuf[nr++] = readio(a);
+			else
+				writeio(a, wbuf[i]);
+	}
+	// }}}
+
 	// Query whether or not an interrupt has taken place
 	virtual	bool	poll(void) = 0;
 
@@ -189,41 +189,41 @@ void	HEXBUS::writeio(const BUSW a, const BUSW v) {
  * really have any 8-bit byte support, although you might be able to create such
  * by readio()'ing a word, modifying it, and then calling writeio() to write the
  * modified word back.
+ *
+ * The whole vector is sent as one burst, and only then are the acknowledgements
+ * collected.  The bus executes each write long before the next write command
+ * can arrive over the serial port, and each acknowledgement is no longer than
+ * the command that produced it, so neither direction can overflow.
  */
 void	HEXBUS::writev(const BUSW a, const int p, const int len,
 		const BUSW *buf) {
 	char	*ptr;
-	unsigned	nw = 0;
 
+	if (len <= 0)
+		return;
 	DBGPRINTF("WRITEV(%08x,%d,#%d,0x%08x ...)\n", a, p, len, buf[0]);
 
+	// Room for the address, and for 'W', eight hex digits, and a newline
+	// per word
+	bufalloc(16 + len * 10);
+
 	// Encode the address
 	ptr = encode_address(a|((p)?0:1));
 	m_lastaddr = a; m_addr_set = true;
 	m_nacks = 0;
 
-	while(nw < (unsigned)len) {
-		*ptr++ = 'W'; *ptr = '\0';
+	for(int nw=0; nw < len; nw++) {
+		*ptr++ = 'W';
 		if (buf[nw] != 0) {
 			sprintf(ptr, "%x\n", buf[nw]);
 			ptr += strlen(ptr);
-		} else {
+		} else
 			*ptr++ = '\n';
-			*ptr = '\0';
-		}
+	} *ptr = '\0';
 
-		DBGPRINTF("WRITEV-SUB(%08x%s,&buf[%d] = 0x%08x,ACKS=%d)\n", a+(nw<<2), (p)?"++":"", nw, buf[nw], m_nacks);
-		m_dev->write(m_buf, ptr-m_buf);
-		DBGPRINTF(">> %s", m_buf);
+	m_dev->write(m_buf, ptr-m_buf);
+	DBGPRINTF(">> %s", m_buf);
 
-		while(m_nacks < (unsigned)nw)
-			readidle();
-
-		nw ++;
-		ptr = m_buf;
-	}
-
-	DBGPRINTF("Missing %d acks still\n", (unsigned)len-m_nacks);
 	while(m_nacks < (unsigned)len)
 		readidle();
 
@@ -251,6 +251,85 @@ void	HEXBUS::writei(const BUSW a, const int len, const BUSW *buf) {
 	writev(a, 1, len, buf);
 } // }}}
 
+/*
+ * xferz
+ * {{{
+ * Write and read a mixed series of values to and from a single address.  The
+ * bus executes commands in the order they arrive, so the whole series is sent
+ * at once, and only then are the read values and write acknowledgements
+ * collected.
+ *
+ * Each write's acknowledgement is shorter than its command, but each read's
+ * response (R, and eight hex digits) is longer than its command (R, and a
+ * newline).  A read is therefore only sent behind other reads so long as the
+ * commands sent ahead of it are at least as long as the responses expected
+ * for them.  Otherwise, what's been sent so far is collected first.
+ */
+void	HEXBUS::xferz(const BUSW a, const int len, const bool *rd,
+		const BUSW *wbuf, BUSW *rbuf) {
+	int	first = 0, nr = 0;
+
+	if (len <= 0)
+		return;
+	DBGPRINTF("XFERZ(%08x,#%d)\n", a, len);
+
+	// Room for the address, and for 'W', eight hex digits, and a newline
+	// per operation
+	bufalloc(16 + len * 10);
+
+	while(first < len) {
+		char	*ptr;
+		int	last, nw = 0, nreads = 0, nin = 0, nout = 0;
+
+		// Encode the address, and then as many operations as we can
+		// send before collecting their responses
+		ptr = encode_address(a|1);
+		m_lastaddr = a; m_addr_set = true; m_inc = 0;
+		nin = ptr - m_buf;
+		nout = nin;
+		for(last=first; last < len; last++) {
+			char	*cmd = ptr;
+
+			if (rd[last]) {
+				if (nreads > 0 && nout + 9 > nin)
+					break;
+				*ptr++ = HEXB_READ;
+				*ptr++ = '\n';
+				nout += 9;
+				nreads++;
+			} else {
+				*ptr++ = 'W';
+				if (wbuf[last] != 0) {
+					sprintf(ptr, "%x\n", wbuf[last]);
+					ptr += strlen(ptr);
+				} else
+					*ptr++ = '\n';
+				nout += 1;
+				nw++;
+			}
+			nin += ptr - cmd;
+		} *ptr = '\0';
+
+		m_dev->write(m_buf, ptr-m_buf);
+		DBGPRINTF(">> %s", m_buf);
+
+		// Collect the responses.  readword() counts any write
+		// acknowledgements it passes along the way.
+		m_nacks = 0;
+		try {
+			for(int k=0; k<nreads; k++)
+				rbuf[nr++] = readword();
+		} catch(BUSERR b) {
+			DBGPRINTF("XFERZ::BUSERR trying to read %08x\n", a);
+			throw BUSERR(a);
+		}
+		while(m_nacks < (unsigned)nw)
+			readidle();
+
+		first = last;
+	}
+} // }}}
+
 /*
  * readio
  * {{{
@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histarc.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Examines a frame archive, as written by the histogram and
+//		constellation programs, offline.  By default, one line is
+//	listed per frame.  Alternatively, the statistics of every frame may be
+//	written as JSON (-s), or the bins of any one frame may be dumped (-x).
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "histstats.h"
+#include "histarchive.h"
+
+void	usage(void) {
+	printf(
+"USAGE: histarc [-s] [-u] [-x frame] archive\n"
+"\n"
+"\tWith no options, lists one line per frame within the archive.\n"
+"\n"
+"\t-s\tWrite the statistics of every frame, as one line of JSON per\n"
+"\t\tframe, to the standard output\n"
+"\t-u\tTreat histogram bins as unsigned when computing statistics\n"
+"\t-x frame\tList the non-zero bins of the given frame\n");
+}
+
+static	const char	*kindname(unsigned kind) {
+	switch(kind) {
+	case HARC_HISTOGRAM:	 return "hist";
+	case HARC_CONSTELLATION: return "cons";
+	default:		 return "????";
+	}
+}
+
+int main(int argc, char **argv) {
+	int		skp=0;
+	bool		stats_flag = false, is_signed = true;
+	long		xframe = -1;
+	HISTARCHIVE	archive;
+	uint64_t	nrec;
+
+	// Argument processing
+	// {{{
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 's') {
+				stats_flag = true;
+			} else if (argv[argn+skp][1] == 'u') {
+				is_signed = false;
+			} else if (argv[argn+skp][1] == 'x') {
+				if (argn+skp+1 >= argc) {
+					fprintf(stderr, "ERR: No frame given to -x\n");
+					exit(EXIT_FAILURE);
+				}
+				xframe = strtol(argv[argn+skp+1], NULL, 0);
+				skp++;	// The option's value
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+	// }}}
+
+	if (argc != 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if (!archive.open(argv[0]))
+		exit(EXIT_FAILURE);
+	nrec = archive.size();
+
+	if (xframe >= 0) {
+		// {{{
+		// record()'s pointer doesn't survive the call to bins(), but
+		// only bins() is needed here.
+		const uint32_t		*bins = archive.bins(xframe);
+
+		if (NULL == bins) {
+			fprintf(stderr, "ERR: No frame %ld, the archive holds %llu\n",
+				xframe, (unsigned long long)nrec);
+			exit(EXIT_FAILURE);
+		}
+
+		for(unsigned k=0; k<archive.nbins(); k++)
+			if (bins[k] != 0)
+				printf("%4d %10u\n", k, bins[k]);
+		// }}}
+	} else if (stats_flag) {
+		// {{{
+		for(uint64_t n=0; n<nrec; n++) {
+			// Copy the record, since bins() may remap the archive
+			// and so invalidate record()'s pointer
+			const HARC_RECORD	rec = *archive.record(n);
+			const uint32_t		*bins = archive.bins(n);
+
+			if (rec.kind == HARC_CONSTELLATION) {
+				CONSTATS	st;
+
+				constats(bins, st);
+				constats_json(stdout, st, rec.tstamp_us);
+			} else {
+				HISTSTATS	st;
+
+				histstats(bins, is_signed, st);
+				histstats_json(stdout, st, rec.tstamp_us);
+			}
+		}
+		// }}}
+	} else {
+		// {{{
+		const HARC_HEADER	&hdr = archive.header();
+
+		printf("# %llu frames of %d bins\n",
+			(unsigned long long)nrec, hdr.nbins);
+		printf("# %-8s %-4s %-26s %-3s %-8s %-8s %-8s %10s\n",
+			"Frame", "Kind", "Time", "Tap", "GPIO", "Build",
+			"Version", "Sum");
+		for(uint64_t n=0; n<nrec; n++) {
+			const HARC_RECORD	*rec = archive.record(n);
+			char			tbuf[32];
+			time_t			secs;
+			struct tm		tm;
+
+			secs = rec->tstamp_us / 1000000;
+			localtime_r(&secs, &tm);
+			strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm);
+
+			printf("  %8llu %-4s %s.%06u %3u %08x %08x %08x %10u%s\n",
+				(unsigned long long)n, kindname(rec->kind),
+				tbuf, (unsigned)(rec->tstamp_us % 1000000),
+				rec->tap, rec->gpio, rec->buildtime,
+				rec->version, rec->sum,
+				(rec->sync != HARC_SYNC) ? " (BAD SYNC)" : "");
+		}
+		// }}}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histarchive.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Implements the HISTARCHIVE, an append-only, memory mapped,
+//		archive of histogram and constellation frames.  See
+//	histarchive.h for a description of the file format.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "histarchive.h"
+
+static const char	HARC_MAGIC[8] = { 'S','D','R','H','A','R','C','\0' };
+
+static_assert(sizeof(HARC_HEADER) == 64, "HARC_HEADER must be 64 bytes");
+static_assert(sizeof(HARC_RECORD) == 64, "HARC_RECORD must be 64 bytes");
+
+bool	HISTARCHIVE::open(const char *fname, bool writable, unsigned nbins) {
+	struct stat	sb;
+
+	close();
+
+	m_writable = writable;
+	m_fd = ::open(fname, (writable) ? (O_RDWR | O_CREAT | O_APPEND)
+				: O_RDONLY, 0644);
+	if (m_fd < 0) {
+		fprintf(stderr, "ERR: Could not open %s, %s\n", fname,
+			strerror(errno));
+		return false;
+	}
+
+	if (0 != fstat(m_fd, &sb)) {
+		fprintf(stderr, "ERR: Could not stat %s\n", fname);
+		close();
+		return false;
+	}
+
+	if (sb.st_size == 0 && writable) {
+		// {{{
+		// A new archive: write its header
+		struct timespec	ts;
+
+		memset(&m_hdr, 0, sizeof(m_hdr));
+		memcpy(m_hdr.magic, HARC_MAGIC, sizeof(m_hdr.magic));
+		m_hdr.version = HARC_VERSION;
+		m_hdr.hdrlen  = sizeof(HARC_HEADER);
+		m_hdr.recsize = sizeof(HARC_RECORD) + nbins * sizeof(uint32_t);
+		m_hdr.nbins   = nbins;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		m_hdr.created_us = (uint64_t)ts.tv_sec * 1000000ul
+					+ ts.tv_nsec / 1000;
+
+		if (sizeof(m_hdr) != write(m_fd, &m_hdr, sizeof(m_hdr))) {
+			fprintf(stderr, "ERR: Could not write to %s\n", fname);
+			close();
+			return false;
+		}
+		// }}}
+	} else {
+		// {{{
+		// An existing archive: check its header
+		if (sizeof(m_hdr) != pread(m_fd, &m_hdr, sizeof(m_hdr), 0)
+			|| 0 != memcmp(m_hdr.magic, HARC_MAGIC,
+						sizeof(m_hdr.magic))) {
+			fprintf(stderr, "ERR: %s is not a frame archive\n",
+				fname);
+			close();
+			return false;
+		} else if (m_hdr.version != HARC_VERSION
+				|| m_hdr.hdrlen < sizeof(HARC_HEADER)
+				|| m_hdr.recsize != sizeof(HARC_RECORD)
+					+ m_hdr.nbins * sizeof(uint32_t)) {
+			fprintf(stderr, "ERR: %s has an unsupported format\n",
+				fname);
+			close();
+			return false;
+		} else if (writable && m_hdr.nbins != nbins) {
+			fprintf(stderr, "ERR: %s holds %d bins per frame, not %d\n",
+				fname, m_hdr.nbins, nbins);
+			close();
+			return false;
+		}
+
+		m_nrecords = (sb.st_size - m_hdr.hdrlen) / m_hdr.recsize;
+
+		// Drop any partially written record at the end, so that
+		// our next record lands where it belongs
+		if (writable && (off_t)(m_hdr.hdrlen
+				+ m_nrecords * m_hdr.recsize) != sb.st_size) {
+			if (0 != ftruncate(m_fd, m_hdr.hdrlen
+					+ m_nrecords * m_hdr.recsize)) {
+				fprintf(stderr, "ERR: Could not truncate %s\n",
+					fname);
+				close();
+				return false;
+			}
+		}
+		// }}}
+	}
+
+	if (writable)
+		m_buf = new char[m_hdr.recsize];
+
+	return true;
+}
+
+void	HISTARCHIVE::close(void) {
+	if (m_map)
+		munmap(m_map, m_maplen);
+	m_map = NULL;
+	m_maplen = 0;
+
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+	m_nrecords = 0;
+
+	delete[] m_buf;
+	m_buf = NULL;
+}
+
+bool	HISTARCHIVE::append(HARC_RECORD &rec, const unsigned *bins) {
+	uint32_t	sum = 0;
+	size_t		ln, nw;
+
+	if (m_fd < 0 || !m_writable)
+		return false;
+
+	for(unsigned k=0; k<m_hdr.nbins; k++)
+		sum += bins[k];
+
+	rec.sync = HARC_SYNC;
+	rec.seq  = (uint32_t)m_nrecords;
+	rec.sum  = sum;
+
+	// Write the whole record at once, so that concurrent readers are
+	// less likely to ever see half of one
+	memcpy(m_buf, &rec, sizeof(rec));
+	memcpy(&m_buf[sizeof(rec)], bins, m_hdr.nbins * sizeof(uint32_t));
+
+	ln = m_hdr.recsize;
+	nw = 0;
+	while(nw < ln) {
+		ssize_t	n = write(m_fd, &m_buf[nw], ln - nw);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			fprintf(stderr, "ERR: Archive write failed, %s\n",
+				strerror(errno));
+			return false;
+		} nw += n;
+	}
+
+	m_nrecords++;
+	return true;
+}
+
+uint64_t	HISTARCHIVE::size(void) {
+	struct stat	sb;
+
+	if (m_fd < 0)
+		return 0;
+	if (!m_writable && 0 == fstat(m_fd, &sb)
+			&& sb.st_size >= (off_t)m_hdr.hdrlen)
+		m_nrecords = (sb.st_size - m_hdr.hdrlen) / m_hdr.recsize;
+	return m_nrecords;
+}
+
+// mapto
+// {{{
+// Make certain record n is within our memory map, growing the map if the
+// archive has grown since it was last mapped
+bool	HISTARCHIVE::mapto(uint64_t n) {
+	size_t	need;
+
+	if (m_fd < 0)
+		return false;
+	if (n >= m_nrecords && n >= size())
+		return false;
+
+	need = m_hdr.hdrlen + (n+1) * (size_t)m_hdr.recsize;
+	if (m_map && need <= m_maplen)
+		return true;
+
+	if (m_map)
+		munmap(m_map, m_maplen);
+
+	m_maplen = m_hdr.hdrlen + m_nrecords * (size_t)m_hdr.recsize;
+	m_map = (char *)mmap(NULL, m_maplen, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (m_map == MAP_FAILED) {
+		fprintf(stderr, "ERR: Could not map the archive, %s\n",
+			strerror(errno));
+		m_map = NULL;
+		m_maplen = 0;
+		return false;
+	}
+
+	return true;
+}
+// }}}
+
+const HARC_RECORD	*HISTARCHIVE::record(uint64_t n) {
+	if (!mapto(n))
+		return NULL;
+	return (const HARC_RECORD *)&m_map[m_hdr.hdrlen + n * m_hdr.recsize];
+}
+
+const uint32_t	*HISTARCHIVE::bins(uint64_t n) {
+	if (!mapto(n))
+		return NULL;
+	return (const uint32_t *)&m_map[m_hdr.hdrlen + n * m_hdr.recsize
+					+ sizeof(HARC_RECORD)];
+}
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histarchive.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	An append-only archive of histogram and constellation frames.
+//
+//	The archive starts with a 64-byte HARC_HEADER, describing the file,
+//	and is followed by a series of fixed size records.  Each record is a
+//	64-byte HARC_RECORD of metadata, followed by nbins 32-bit bin counts.
+//	Since every record has the same size, record n is always found at
+//	hdrlen + n * recsize.  Records are never rewritten once appended.  A
+//	record that was only partially written, such as by a program killed
+//	mid-write, is discarded the next time the archive is opened for
+//	writing.
+//
+//	Readers map the archive into memory, and so may walk through days of
+//	frames without ever copying or parsing them.  Everything is stored in
+//	the host's (little endian) byte order.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	HISTARCHIVE_H
+#define	HISTARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define	HARC_VERSION		1
+#define	HARC_SYNC		0x4d524648	// "HFRM"
+
+// Record kinds
+#define	HARC_HISTOGRAM		1
+#define	HARC_CONSTELLATION	2
+
+// The GPIO bits selecting the debugging tap point: GPIO[7:6] selects
+// the tap within a transmitter or receiver, and GPIO[8] selects between the
+// transmitter (0) and receiver (1).
+#define	HARC_TAP(GPIO)		(((GPIO) >> 6) & 7)
+
+// HARC_HEADER
+// {{{
+typedef	struct	HARC_HEADER_S {
+	char		magic[8];	// "SDRHARC\0"
+	uint32_t	version;	// HARC_VERSION
+	uint32_t	hdrlen;		// Bytes before the first record
+	uint32_t	recsize;	// Bytes per record, metadata plus bins
+	uint32_t	nbins;		// Bins per record
+	uint64_t	created_us;	// When the archive was created
+	uint32_t	reserved[8];
+} HARC_HEADER;
+// }}}
+
+// HARC_RECORD
+// {{{
+typedef	struct	HARC_RECORD_S {
+	uint32_t	sync;		// HARC_SYNC
+	uint32_t	kind;		// HARC_HISTOGRAM or HARC_CONSTELLATION
+	uint64_t	tstamp_us;	// Host time of the read, in microseconds
+	uint32_t	seq;		// Index of this record within the archive
+	uint32_t	flags;		// Reader specific, such as histogram's HISTF_*
+	uint32_t	gpio;		// R_GPIO when the frame was read
+	uint32_t	tap;		// HARC_TAP(gpio)
+	uint32_t	buildtime;	// R_BUILDTIME of the design
+	uint32_t	version;	// R_VERSION of the design
+	uint32_t	sum;		// Sum of all bins
+	uint32_t	reserved[5];
+} HARC_RECORD;
+// }}}
+
+/*
+ * HISTARCHIVE
+ * {{{
+ * An archive may be opened for reading, or for appending.  Either way the
+ * records already within it may be read back.  Pointers returned by record()
+ * and bins() point into the file's memory map, and remain valid only until
+ * the next call to size(), record(), bins(), or close().
+ */
+class	HISTARCHIVE {
+	int		m_fd;
+	bool		m_writable;
+	HARC_HEADER	m_hdr;
+	uint64_t	m_nrecords;
+	char		*m_map;		// Read only map of the archive
+	size_t		m_maplen;
+	char		*m_buf;		// One record, used when appending
+
+	bool	mapto(uint64_t n);
+public:
+	HISTARCHIVE(void) : m_fd(-1), m_writable(false), m_nrecords(0),
+		m_map(NULL), m_maplen(0), m_buf(NULL) {}
+	~HISTARCHIVE(void) { close(); }
+
+	// Open an archive.  When writable, the archive is created if it
+	// doesn't exist, with nbins bins per record.  Returns false, having
+	// written an error message to stderr, if the file can't be opened or
+	// isn't an archive with nbins bins per record.
+	bool	open(const char *fname, bool writable = false,
+				unsigned nbins = 1024);
+	void	close(void);
+	bool	is_open(void) const { return m_fd >= 0; }
+
+	// Append a record.  The sync, seq, and sum fields of rec are filled
+	// in here.  Returns false on any write error.
+	bool	append(HARC_RECORD &rec, const unsigned *bins);
+
+	// The number of records, including any appended by other processes
+	// since we last looked
+	uint64_t	size(void);
+	unsigned	nbins(void) const { return m_hdr.nbins; }
+	const HARC_HEADER	&header(void) const { return m_hdr; }
+
+	// Random access to record n's metadata and bins, or NULL if there is
+	// no such record
+	const HARC_RECORD	*record(uint64_t n);
+	const uint32_t		*bins(uint64_t n);
+};
+// }}}
+
+#endif	// HISTARCHIVE_H
@@ -4,9 +4,14 @@
 // {{{
 // Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
 //
-// Purpose:	To give a user access, via a command line program, to read
-//		and write wishbone registers one at a time.  Thus this program
-//	implements readio() and writeio() but nothing more.
+// Purpose:	Reads the histogram from the debugging histogram core, and
+//		displays it on the screen.  By default, the histogram is read
+//	once and written to hist.bin.  In monitor mode (-m), the histogram is
+//	instead re-read each time the core signals (via the bus interrupt)
+//	that it has completed a new frame, up to a given maximum rate.  Only
+//	the rows that have changed are redrawn.  Either way, frames may also
+//	be appended, along with the design's identity and tap selection, to a
+//	frame archive (-o).  See histarchive.h.
 //
 //
 // Creator:	Dan Gisselquist, Ph.D.
@@ -40,42 +45,107 @@
 // }}}
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <strings.h>
 #include <ctype.h>
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <time.h>
 
 #include "port.h"
 #include "regdefs.h"
 #include "hexbus.h"
+#include "histstats.h"
+#include "histarchive.h"
+#include "histread.h"
+
+#define	NBINS		HISTREAD_NBINS
+// Each monitor row summarizes NBINS/NROWS adjacent bins
+#define	NROWS		64
+#define	BINS_PER_ROW	(NBINS/NROWS)
+#define	BARLEN		64
 
 FPGA	*m_fpga;
+HISTREADER	*m_reader;
+volatile bool	m_done = false;
+bool		m_sparse = true;
+bool		m_signed = true;
+FILE		*m_statsfp = NULL;
+HISTARCHIVE	*m_archive = NULL;
+HARC_RECORD	m_ident;	// Design identity, common to all archive records
+
 void	closeup(int v) {
 	m_fpga->kill();
 	exit(0);
 }
 
+void	stopmonitor(int v) {
+	m_done = true;
+}
+
 void	usage(void) {
-	printf("USAGE: histogram\n");
+	printf(
+"USAGE: histogram [-n host] [-p port] [-f] [-u] [-s file] [-m] [-r rate]\n"
+"\t\t[-c count] [-o file]\n"
+"\n"
+"\t-n host\tThe network host name of the bus server [%s]\n"
+"\t-p port\tThe network port of the bus server [%d]\n"
+"\n"
+"\tWith no further options, the histogram is read once, drawn, and\n"
+"\twritten to hist.bin.\n"
+"\n"
+"\t-f\tRead every bin, rather than only the blocks of bins that the\n"
+"\t\thistogram's occupancy map reports as holding counts\n"
+"\t-u\tTreat the bin numbers as unsigned values when computing\n"
+"\t\tstatistics.  The default is 10-bit two's complement.\n"
+"\t-s file\tAppend the statistics of every frame, one line of JSON per\n"
+"\t\tframe, to file.  Use - for the standard output.\n"
+"\t-m\tMonitor the histogram, drawing each new frame as it arrives\n"
+"\t-r rate\tMaximum number of frames per second to read in monitor\n"
+"\t\tmode [default: 4]\n"
+"\t-c count\tStop after count frames.  The default is to run until\n"
+"\t\tinterrupted with a ^C\n"
+"\t-o file\tAppend every frame, together with its timestamp, tap\n"
+"\t\tselection and the design's build time and version, to the\n"
+"\t\tframe archive, file\n", FPGAHOST, FPGAPORT);
 }
 
-int main(int argc, char **argv) {
-	const char *host = FPGAHOST;
-	int	port=FPGAPORT;
-	unsigned	hbuf[1024];
-	int		lastzero = 0, sum = 0;
+// archive_frame
+// {{{
+// Append a frame to the archive, if we have one
+void	archive_frame(const unsigned *hbuf, unsigned flags, uint64_t tstamp) {
+	HARC_RECORD	rec;
 
-	m_fpga = new FPGA(new NETCOMMS(host, port));
+	if (NULL == m_archive)
+		return;
 
-	signal(SIGSTOP, closeup);
-	signal(SIGHUP, closeup);
+	rec = m_ident;
+	rec.kind      = HARC_HISTOGRAM;
+	rec.tstamp_us = tstamp;
+	rec.flags     = flags;
+	rec.gpio      = m_fpga->readio(R_GPIO);
+	rec.tap       = HARC_TAP(rec.gpio);
+	if (!m_archive->append(rec, hbuf)) {
+		delete m_archive;
+		m_archive = NULL;
+	}
+}
+// }}}
 
-	m_fpga->readi(R_HISTOGRAM, 1024, hbuf);
+// snapshot
+// {{{
+// The original one-shot histogram dump
+void	snapshot(void) {
+	unsigned	hbuf[NBINS], flags;
+	int		lastzero = 0, sum = 0;
+	uint64_t	tstamp;
+
+	flags = m_reader->read_frame(hbuf, &tstamp);
 	lastzero = 0;
 	sum = 0;
-	for(int k=0; k<1024; k++) {
+	for(int k=0; k<NBINS; k++) {
 		// {{{
 		sum = sum + hbuf[k];
 		if (hbuf[k] == 0)
@@ -95,14 +165,254 @@ int main(int argc, char **argv) {
 		printf("  *****\n");
 
 	printf("Total sum: %5d\n", sum);
+	printf("Read %4u bus words\n", m_reader->words_read());
+
+	archive_frame(hbuf, flags, tstamp);
+
+	if (m_statsfp) {
+		HISTSTATS	st;
+
+		histstats(hbuf, m_signed, st);
+		histstats_json(m_statsfp, st, tstamp);
+		fflush(m_statsfp);
+	}
 
 	FILE	*hp;
 	hp = fopen("hist.bin","w");
-	fwrite(hbuf, sizeof(int), 1024, hp);
+	fwrite(hbuf, sizeof(int), NBINS, hp);
 	fclose(hp);
 
-	if (m_fpga->poll())
-		printf("FPGA was interrupted\n");
-	delete	m_fpga;
+	if (flags & HISTF_TIMEOUT)
+		printf("No histogram interrupt was received\n");
+	else if (flags & HISTF_TORN)
+		printf("WARNING: Histogram was updated while being read\n");
+}
+// }}}
+
+// drawrow
+// {{{
+// Draw one row of the monitor display, at screen line 3+row
+void	drawrow(int row, unsigned total, int delta, unsigned scale) {
+	int	nbar = 0;
+
+	if (scale > 0)
+		nbar = (int)(((uint64_t)total * BARLEN + scale-1) / scale);
+	if (nbar > BARLEN)
+		nbar = BARLEN;
+
+	printf("\033[%d;1H@%4d #%8u %+8d: ", row+3, row*BINS_PER_ROW,
+		total, delta);
+	for(int j=0; j<nbar; j++)
+		putchar('+');
+	printf("\033[K");
 }
+// }}}
+
+// monitor
+// {{{
+// Repeatedly read the histogram, once per histogram interrupt but no more
+// than rate times per second, and redraw only those rows that have changed.
+void	monitor(double rate, unsigned count) {
+	unsigned	*hbuf, *last;
+	unsigned	rowsum[NROWS], lastrow[NROWS];
+	int		rowdelta[NROWS], lastdelta[NROWS];
+	unsigned	scale = 0;
+	uint64_t	interval_ms, next_ms;
+	bool		first = true;
+	unsigned	frame = 0;
+
+	hbuf = new unsigned[NBINS];
+	last = new unsigned[NBINS];
+	memset(last, 0, NBINS * sizeof(unsigned));
+	memset(lastrow, 0, sizeof(lastrow));
+	memset(lastdelta, 0, sizeof(lastdelta));
+
+	interval_ms = (rate > 0) ? (uint64_t)(1000.0 / rate) : 0;
+
+	// Clear the screen and hide the cursor
+	printf("\033[2J\033[?25l");
+	fflush(stdout);
+
+	next_ms = monotonic_ms();
+	while(!m_done && (count == 0 || frame < count)) {
+		unsigned	fflags;
+		uint64_t	tstamp;
+		unsigned	sum = 0, nchanged = 0, newscale = scale;
+		bool		redraw;
+		HISTSTATS	stats;
+
+		// Rate limit: sleep on the bus, rather than the host, so that
+		// any bus traffic keeps getting processed
+		while(!m_done && monotonic_ms() < next_ms)
+			m_fpga->usleep((unsigned)(next_ms - monotonic_ms()));
+		if (m_done)
+			break;
+		next_ms += interval_ms;
+		if (next_ms < monotonic_ms())
+			next_ms = monotonic_ms();
 
+		fflags = m_reader->read_frame(hbuf, &tstamp);
+		if (m_done)
+			break;
+
+		for(int r=0; r<NROWS; r++)
+			rowsum[r] = 0;
+		for(int k=0; k<NBINS; k++) {
+			sum += hbuf[k];
+			if (hbuf[k] != last[k])
+				nchanged++;
+			rowsum[k / BINS_PER_ROW] += hbuf[k];
+		} for(int r=0; r<NROWS; r++) {
+			rowdelta[r] = (int)(rowsum[r] - lastrow[r]);
+			if (rowsum[r] > newscale)
+				newscale = rowsum[r];
+		}
+
+		// The scale only ever grows, and then only by powers of two,
+		// so that the bars don't all jump (and so need redrawing)
+		// every time the peak moves
+		redraw = first;
+		if (newscale > scale) {
+			scale = 1;
+			while(scale < newscale)
+				scale <<= 1;
+			redraw = true;
+		}
+
+		printf("\033[1;1HFrame %6u  Sum %10u  Changed %4u  Read %4u  Scale %u/%d%s\033[K",
+			frame, sum, nchanged, m_reader->words_read(), scale, BARLEN,
+			(fflags & HISTF_TIMEOUT) ? "  (no interrupt)"
+			: (fflags & HISTF_TORN) ? "  (torn)" : "");
+
+		histstats(hbuf, m_signed, stats);
+		if (stats.total > 0)
+			printf("\033[2;1HMean %8.2f  StdDev %7.2f  Skew %6.2f  Median %4d  Clipped %6.2f%%\033[K",
+				stats.mean, stats.stddev, stats.skew,
+				stats.pct[HISTSTATS_MEDIAN], 100.0 * stats.clipped);
+		else
+			printf("\033[2;1H\033[K");
+		if (m_statsfp) {
+			histstats_json(m_statsfp, stats, tstamp);
+			fflush(m_statsfp);
+		}
+		for(int r=0; r<NROWS; r++) {
+			if (redraw || rowsum[r] != lastrow[r]
+					|| rowdelta[r] != lastdelta[r])
+				drawrow(r, rowsum[r], rowdelta[r], scale);
+		}
+		printf("\033[%d;1H", NROWS+3);
+		fflush(stdout);
+
+		archive_frame(hbuf, fflags, tstamp);
+
+		{ unsigned *tmp = last; last = hbuf; hbuf = tmp; }
+		memcpy(lastrow, rowsum, sizeof(lastrow));
+		memcpy(lastdelta, rowdelta, sizeof(lastdelta));
+		first = false;
+		frame++;
+	}
+
+	// Restore the cursor
+	printf("\033[%d;1H\033[?25h\n", NROWS+3);
+	fflush(stdout);
+
+	delete[] hbuf;
+	delete[] last;
+}
+// }}}
+
+int main(int argc, char **argv) {
+	int	skp=0;
+	const char *host = FPGAHOST, *archive_fname = NULL,
+			*stats_fname = NULL;
+	int	port=FPGAPORT;
+	bool	monitor_flag = false;
+	double	rate = 4.0;
+	unsigned count = 0;
+
+	// Argument processing
+	// {{{
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 'm') {
+				monitor_flag = true;
+			} else if (argv[argn+skp][1] == 'f') {
+				m_sparse = false;
+			} else if (argv[argn+skp][1] == 'u') {
+				m_signed = false;
+			} else if (argv[argn+skp][1]
+					&& strchr("nprcos", argv[argn+skp][1])) {
+				char	opt = argv[argn+skp][1];
+
+				if (argn+skp+1 >= argc) {
+					fprintf(stderr, "ERR: No argument given to -%c\n", opt);
+					exit(EXIT_FAILURE);
+				}
+
+				const char *val = argv[argn+skp+1];
+				if (opt == 'n')
+					host = val;
+				else if (opt == 'p')
+					port = strtoul(val, NULL, 0);
+				else if (opt == 'r')
+					rate = atof(val);
+				else if (opt == 'c')
+					count = strtoul(val, NULL, 0);
+				else if (opt == 's')
+					stats_fname = val;
+				else // if (opt == 'o')
+					archive_fname = val;
+				skp++;	// The option's value
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+	// }}}
+
+	if (archive_fname) {
+		m_archive = new HISTARCHIVE();
+		if (!m_archive->open(archive_fname, true, NBINS))
+			exit(EXIT_FAILURE);
+	}
+
+	if (stats_fname) {
+		if (0 == strcmp(stats_fname, "-"))
+			m_statsfp = stdout;
+		else if (NULL == (m_statsfp = fopen(stats_fname, "a"))) {
+			fprintf(stderr, "ERR: Could not open %s\n", stats_fname);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	m_fpga = new FPGA(new NETCOMMS(host, port));
+	m_reader = new HISTREADER(m_fpga);
+	m_reader->set_sparse(m_sparse);
+	m_reader->set_abort(&m_done);
+
+	signal(SIGSTOP, closeup);
+	signal(SIGHUP, closeup);
+
+	if (m_archive) {
+		memset(&m_ident, 0, sizeof(m_ident));
+		m_ident.buildtime = m_fpga->readio(R_BUILDTIME);
+		m_ident.version   = m_fpga->readio(R_VERSION);
+	}
+
+	if (monitor_flag) {
+		signal(SIGINT, stopmonitor);
+		signal(SIGTERM, stopmonitor);
+		monitor(rate, count);
+	} else
+		snapshot();
+
+	if (m_statsfp && m_statsfp != stdout)
+		fclose(m_statsfp);
+	delete	m_archive;
+	delete	m_reader;
+	delete	m_fpga;
+}
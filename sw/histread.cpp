@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histread.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Implements the HISTREADER, which reads complete frames from
+//		the histogram core.  See histread.h for details.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "regdefs.h"
+#include "histread.h"
+
+// Occupied blocks separated by no more than this many empty blocks are read
+// with a single readi().  Reading a short gap of zeros costs less than the
+// round trip of starting another read.
+#define	MERGE_GAP	1
+// How many times to re-read a frame that was torn by a bank swap
+#define	MAX_REREADS	3
+
+uint64_t	wallclock_us(void) {
+	// {{{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+// }}}
+
+uint64_t	monotonic_ms(void) {
+	// {{{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+// }}}
+
+uint64_t	monotonic_us(void) {
+	// {{{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+// }}}
+
+unsigned	HISTREADER::read_bins(unsigned *hbuf) {
+	// {{{
+	unsigned	occ, nwords = 0;
+
+	if (!m_sparse) {
+		m_fpga->readi(R_HISTOGRAM, HISTREAD_NBINS, hbuf);
+		return m_words_read = HISTREAD_NBINS;
+	}
+
+	occ = m_fpga->readio(R_HISTOCC);
+	nwords++;
+
+	memset(hbuf, 0, HISTREAD_NBINS * sizeof(unsigned));
+	for(int blk=0; blk<HISTREAD_NBLOCKS; ) {
+		int	last;
+
+		if (0 == (occ & (1u << blk))) {
+			blk++;
+			continue;
+		}
+
+		// Coalesce any following blocks, across small gaps
+		last = blk;
+		for(int k=blk+1; k<HISTREAD_NBLOCKS && k <= last+1+MERGE_GAP;
+				k++)
+			if (occ & (1u << k))
+				last = k;
+
+		m_fpga->readi(R_HISTOGRAM + blk * HISTREAD_BLKSZ * 4,
+				(last+1-blk) * HISTREAD_BLKSZ,
+				&hbuf[blk * HISTREAD_BLKSZ]);
+		nwords += (last+1-blk) * HISTREAD_BLKSZ;
+		blk = last+1;
+	}
+
+	return m_words_read = nwords;
+}
+// }}}
+
+unsigned	HISTREADER::read_frame(unsigned *hbuf, uint64_t *tstamp) {
+	// {{{
+	unsigned	flags;
+	uint64_t	start_ms;
+
+	m_fpga->clear();
+	start_ms = monotonic_ms();
+	while((!m_abort || !*m_abort) && !m_fpga->poll()
+			&& monotonic_ms() - start_ms < m_timeout_ms)
+		m_fpga->usleep(10);
+	flags = (m_fpga->poll()) ? HISTF_INTERRUPT : HISTF_TIMEOUT;
+
+	for(int tries=0; ; tries++) {
+		m_fpga->clear();
+		if (tstamp)
+			*tstamp = wallclock_us();
+		read_bins(hbuf);
+		if (!m_fpga->poll() || (flags & HISTF_TIMEOUT))
+			break;
+		if (tries >= MAX_REREADS) {
+			flags |= HISTF_TORN;
+			break;
+		} flags |= HISTF_REREAD;
+	}
+
+	return flags;
+}
+// }}}
@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histread.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Reads complete frames from the histogram core, as used by
+//		both the histogram and constellation programs.
+//
+//	The bus always reads from the histogram's idle bank.  A HISTREADER
+//	waits for the core to swap banks (i.e. for its interrupt), so that
+//	it has a full averaging window in which to read the histogram the core
+//	just completed.  Should the core swap again before the read finishes,
+//	the copy holds parts of two histograms, and so it is read again.
+//
+//	Unless told otherwise, only the blocks of bins the core's occupancy
+//	map reports as holding counts are read.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	HISTREAD_H
+#define	HISTREAD_H
+
+#include <stdint.h>
+#include "devbus.h"
+
+#define	HISTREAD_NBINS		1024
+// The core's occupancy map, R_HISTOCC, has one bit per block of BLKSZ bins
+#define	HISTREAD_NBLOCKS	32
+#define	HISTREAD_BLKSZ		(HISTREAD_NBINS/HISTREAD_NBLOCKS)
+
+// Reader flags, as returned by read_frame() and recorded within archives
+// {{{
+#define	HISTF_INTERRUPT	1	// Frame read following a histogram interrupt
+#define	HISTF_TIMEOUT	2	// No interrupt arrived, frame read anyway
+#define	HISTF_REREAD	4	// The first read was torn by a bank swap
+#define	HISTF_TORN	8	// Even the last re-read was torn
+// }}}
+
+// Host clocks: wall clock time for timestamps, and monotonic millisecond and
+// microsecond clocks for pacing
+extern	uint64_t	wallclock_us(void);
+extern	uint64_t	monotonic_ms(void);
+extern	uint64_t	monotonic_us(void);
+
+class	HISTREADER {
+	DEVBUS		*m_fpga;
+	bool		m_sparse;
+	unsigned	m_words_read, m_timeout_ms;
+	volatile bool	*m_abort;
+public:
+	HISTREADER(DEVBUS *fpga) : m_fpga(fpga), m_sparse(true),
+		m_words_read(0), m_timeout_ms(2000), m_abort(NULL) {}
+
+	// Read every bin, rather than just the occupied blocks
+	void	set_sparse(bool sparse) { m_sparse = sparse; }
+	// How long to wait on the histogram interrupt before reading anyway
+	void	set_timeout(unsigned ms) { m_timeout_ms = ms; }
+	// Stop waiting on the interrupt once *abort becomes true
+	void	set_abort(volatile bool *abort) { m_abort = abort; }
+
+	// Read the histogram's bins as they are now, into hbuf.  Returns the
+	// number of bus words read.
+	unsigned	read_bins(unsigned *hbuf);
+
+	// Wait for, and then read, a complete frame, recording the time it
+	// was read into *tstamp (if given).  Returns the HISTF_* flags
+	// describing the read.
+	unsigned	read_frame(unsigned *hbuf, uint64_t *tstamp = NULL);
+
+	// The number of bus words used by the last read
+	unsigned	words_read(void) const { return m_words_read; }
+};
+
+#endif	// HISTREAD_H
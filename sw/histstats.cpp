@@ -0,0 +1,291 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histstats.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Computes summary statistics of histogram and constellation
+//		frames, as described in histstats.h.
+//
+//	The bin loops are written to be vectorized: they're branch free, run
+//	over contiguous bins, and are marked as SIMD reductions.  (The Makefile
+//	builds this file with -O3 -fopenmp-simd.)  Although the sums are
+//	accumulated as doubles, every term is an integer.  So long as a frame
+//	holds fewer than 2^24 counts, every partial sum is then an integer
+//	below 2^53, and so the sums are exact no matter the order in which
+//	they are accumulated.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "histstats.h"
+
+const int	HISTSTATS_PCTILES[HISTSTATS_NPCT] = { 1, 5, 25, 50, 75, 95, 99 };
+
+// jsonval
+// {{{
+// JSON has no representation for infinities or NaNs
+static	void	jsonval(FILE *fp, const char *name, double v) {
+	if (isfinite(v))
+		fprintf(fp, ",\"%s\":%.6g", name, v);
+	else
+		fprintf(fp, ",\"%s\":null", name);
+}
+// }}}
+
+// moments
+// {{{
+// Accumulate the first four raw moment sums of n contiguous bins, where bin
+// j holds the value x0+j
+static	void	moments(const unsigned *h, int n, double x0, double *sums) {
+	double	s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+#pragma omp simd reduction(+:s0,s1,s2,s3)
+	for(int j=0; j<n; j++) {
+		double	c = h[j], x = x0 + j;
+
+		s0 += c;
+		s1 += c * x;
+		s2 += c * x * x;
+		s3 += c * x * x * x;
+	}
+
+	sums[0] += s0; sums[1] += s1; sums[2] += s2; sums[3] += s3;
+}
+// }}}
+
+// histstats
+// {{{
+void	histstats(const unsigned *hist, bool is_signed, HISTSTATS &st) {
+	const int	N = HISTSTATS_NBINS, flip = (is_signed) ? N/2 : 0;
+	double		sums[4] = { 0, 0, 0, 0 }, s0;
+	uint64_t	cum, target[HISTSTATS_NPCT];
+	int		p;
+
+	memset(&st, 0, sizeof(st));
+
+	// For signed bins, the top half of the bins hold -512 through -1
+	if (is_signed) {
+		moments(&hist[N/2], N/2, -N/2, sums);
+		moments(hist, N/2, 0, sums);
+	} else
+		moments(hist, N, 0, sums);
+
+	s0 = sums[0];
+	st.total = (uint64_t)s0;
+	if (s0 == 0)
+		return;
+
+	st.mean     = sums[1] / s0;
+	st.variance = sums[2] / s0 - st.mean * st.mean;
+	if (st.variance < 0)
+		st.variance = 0;
+	st.stddev   = sqrt(st.variance);
+	if (st.variance > 0)
+		st.skew = (sums[3] / s0
+			- 3 * st.mean * st.variance
+			- st.mean * st.mean * st.mean)
+			/ (st.variance * st.stddev);
+
+	st.clipped = (double)(hist[0 ^ flip] + hist[(N-1) ^ flip]) / s0;
+
+	// Minimum, maximum, and percentiles, from the cumulative count.  Here
+	// we visit the bins in value order, j, so that bin j^flip holds the
+	// value j-flip: for signed bins, bins 512 (-512) through 1023 (-1),
+	// followed by bins 0 through 511.
+	for(p=0; p<HISTSTATS_NPCT; p++) {
+		target[p] = (st.total * HISTSTATS_PCTILES[p] + 99) / 100;
+		if (target[p] < 1)
+			target[p] = 1;
+	}
+
+	st.minval = N;
+	cum = 0; p = 0;
+	for(int j=0; j<N; j++) {
+		unsigned	c = hist[j ^ flip];
+
+		if (c == 0)
+			continue;
+		if (st.minval == N)
+			st.minval = j - flip;
+		st.maxval = j - flip;
+
+		cum += c;
+		while(p < HISTSTATS_NPCT && cum >= target[p])
+			st.pct[p++] = j - flip;
+	}
+}
+// }}}
+
+// constats
+// {{{
+void	constats(const unsigned *hist, CONSTATS &st) {
+	// All coordinates are kept in units of half an LSB, so that the
+	// bin centers (v + 1/2) remain integers
+	double	s0 = 0, si = 0, sq = 0, sabs = 0, spow = 0, sclip = 0;
+	double	qsum_i[4] = { 0, 0, 0, 0 }, qsum_q[4] = { 0, 0, 0, 0 };
+	double	err, ref;
+
+	memset(&st, 0, sizeof(st));
+
+	for(int ir=0; ir<32; ir++) {
+		// The top five bits of the bin index are I
+		const	unsigned *row = &hist[ir * 32];
+		const	double	i2 = 2 * ((ir ^ 16) - 16) + 1;
+		const	bool	edge_row = (ir == 15 || ir == 16);
+
+		for(int half=0; half<2; half++) {
+			// The bottom five, Q: non-negative in the first half
+			// of each row, negative in the second
+			const	unsigned *cp = &row[half * 16];
+			const	double	q0 = (half) ? -31 : 1;
+			double		c0 = 0, cq = 0, cqq = 0;
+			int		quad;
+
+#pragma omp simd reduction(+:c0,cq,cqq)
+			for(int j=0; j<16; j++) {
+				double	c = cp[j], q2 = q0 + 2 * j;
+
+				c0  += c;
+				cq  += c * q2;
+				cqq += c * q2 * q2;
+			}
+
+			if (i2 > 0)
+				quad = (half) ? 3 : 0;
+			else
+				quad = (half) ? 2 : 1;
+
+			st.qcount[quad] += (uint64_t)c0;
+			qsum_i[quad] += c0 * i2;
+			qsum_q[quad] += cq;
+
+			s0   += c0;
+			si   += c0 * i2;
+			sq   += cq;
+			sabs += c0 * fabs(i2) + fabs(cq);
+			spow += c0 * i2 * i2 + cqq;
+
+			if (edge_row)
+				sclip += c0;
+			else if (half)
+				sclip += cp[0];		// Q = -16
+			else
+				sclip += cp[15];	// Q = 15
+		}
+	}
+
+	st.total = (uint64_t)s0;
+	if (s0 == 0)
+		return;
+
+	st.mean_i = si / (2.0 * s0);
+	st.mean_q = sq / (2.0 * s0);
+	st.clipped = sclip / s0;
+
+	for(int q=0; q<4; q++) if (st.qcount[q] > 0) {
+		st.qcentroid_i[q] = qsum_i[q] / (2.0 * st.qcount[q]);
+		st.qcentroid_q[q] = qsum_q[q] / (2.0 * st.qcount[q]);
+	}
+
+	// With A the estimated amplitude (in half LSBs), A = sabs / (2 s0),
+	// the total squared error against the ideal points (+/-A, +/-A) is
+	//	sum c (|i|-A)^2 + (|q|-A)^2 = spow - 2 A sabs + 2 A^2 s0
+	//					= spow - sabs^2 / (2 s0)
+	// and the total ideal symbol power is 2 A^2 s0 = sabs^2 / (2 s0).
+	ref = sabs * sabs / (2.0 * s0);
+	err = spow - ref;
+	if (err < 0)
+		err = 0;
+
+	st.amplitude = sabs / (4.0 * s0);
+	if (ref > 0) {
+		st.evm_pct = 100.0 * sqrt(err / ref);
+		st.mer_db  = (err > 0) ? 10.0 * log10(ref / err) : INFINITY;
+	}
+}
+// }}}
+
+// histstats_json
+// {{{
+void	histstats_json(FILE *fp, const HISTSTATS &st, uint64_t tstamp_us) {
+	fprintf(fp, "{\"type\":\"histogram\"");
+	if (tstamp_us)
+		fprintf(fp, ",\"time\":%llu.%06llu",
+			(unsigned long long)(tstamp_us / 1000000),
+			(unsigned long long)(tstamp_us % 1000000));
+	fprintf(fp, ",\"total\":%llu", (unsigned long long)st.total);
+	if (st.total > 0) {
+		fprintf(fp, ",\"min\":%d,\"max\":%d", st.minval, st.maxval);
+		jsonval(fp, "mean",     st.mean);
+		jsonval(fp, "variance", st.variance);
+		jsonval(fp, "stddev",   st.stddev);
+		jsonval(fp, "skew",     st.skew);
+		for(int p=0; p<HISTSTATS_NPCT; p++)
+			fprintf(fp, ",\"p%d\":%d", HISTSTATS_PCTILES[p],
+				st.pct[p]);
+		jsonval(fp, "clipped",  st.clipped);
+	}
+	fprintf(fp, "}\n");
+}
+// }}}
+
+// constats_json
+// {{{
+void	constats_json(FILE *fp, const CONSTATS &st, uint64_t tstamp_us) {
+	fprintf(fp, "{\"type\":\"constellation\"");
+	if (tstamp_us)
+		fprintf(fp, ",\"time\":%llu.%06llu",
+			(unsigned long long)(tstamp_us / 1000000),
+			(unsigned long long)(tstamp_us % 1000000));
+	fprintf(fp, ",\"total\":%llu", (unsigned long long)st.total);
+	if (st.total > 0) {
+		jsonval(fp, "mean_i",    st.mean_i);
+		jsonval(fp, "mean_q",    st.mean_q);
+		jsonval(fp, "amplitude", st.amplitude);
+		jsonval(fp, "evm_pct",   st.evm_pct);
+		jsonval(fp, "mer_db",    st.mer_db);
+		fprintf(fp, ",\"quadrants\":[");
+		for(int q=0; q<4; q++) {
+			fprintf(fp, "%s{\"count\":%llu", (q) ? ",":"",
+				(unsigned long long)st.qcount[q]);
+			if (st.qcount[q] > 0) {
+				jsonval(fp, "i", st.qcentroid_i[q]);
+				jsonval(fp, "q", st.qcentroid_q[q]);
+			} fprintf(fp, "}");
+		} fprintf(fp, "]");
+		jsonval(fp, "clipped",   st.clipped);
+	}
+	fprintf(fp, "}\n");
+}
+// }}}
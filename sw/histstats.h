@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	histstats.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Summary statistics of the histograms read back from the
+//		histogram core.  Two interpretations are supported: a one
+//	dimensional histogram of (signed or unsigned) sample values, and the
+//	32x32 constellation histogram, where the top five bits of the bin
+//	index are the in-phase sample and the bottom five the quadrature
+//	sample, both in two's complement.
+//
+//	Everything is computed from a small number of integer sums over the
+//	bins, so the statistics are cheap enough to compute on every frame
+//	of a streaming monitor.  Results may be written as a single line of
+//	JSON, for the benefit of any scripts watching the link.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	HISTSTATS_H
+#define	HISTSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define	HISTSTATS_NBINS		1024
+#define	HISTSTATS_NPCT		7
+#define	HISTSTATS_MEDIAN	3	// Index of the 50th percentile in pct[]
+
+// The percentiles reported within HISTSTATS::pct[]
+extern	const int	HISTSTATS_PCTILES[HISTSTATS_NPCT];
+
+// HISTSTATS
+// {{{
+// Statistics of a one dimensional histogram.  Bin values are either the bin
+// index (unsigned), or the bin index as a 10-bit two's complement number
+// (signed).  Unless total is zero, in which case everything else is zero
+// as well.
+typedef	struct	HISTSTATS_S {
+	uint64_t	total;		// Total number of counts
+	int		minval, maxval;	// Smallest/largest value with counts
+	double		mean, variance, stddev, skew;
+	int		pct[HISTSTATS_NPCT];	// See HISTSTATS_PCTILES
+	// Fraction of all counts found in the two extreme bins, i.e. at
+	// the smallest or largest representable values.
+	double		clipped;
+} HISTSTATS;
+// }}}
+
+// CONSTATS
+// {{{
+// Statistics of a QPSK constellation.  Each bin is taken to represent the
+// center of the range of values that truncated to it, so that a constellation
+// that is perfectly symmetric about the origin has a mean of zero.
+//
+// The ideal symbol amplitude is estimated from the data as the mean of |I|
+// and |Q| over every count, and each count is then compared against the
+// ideal point of its quadrant.  EVM is the RMS error relative to the RMS
+// ideal symbol, as a percentage.  MER is the ratio of the ideal symbol power
+// to the error power, in dB.
+typedef	struct	CONSTATS_S {
+	uint64_t	total;
+	double		mean_i, mean_q;
+	double		amplitude;	// Estimated ideal |I| = |Q|
+	double		evm_pct, mer_db;
+	// Per quadrant, numbered as in the complex plane: 0 = (+,+),
+	// 1 = (-,+), 2 = (-,-), and 3 = (+,-)
+	uint64_t	qcount[4];
+	double		qcentroid_i[4], qcentroid_q[4];
+	// Fraction of counts on the outer ring of the 32x32 grid
+	double		clipped;
+} CONSTATS;
+// }}}
+
+extern	void	histstats(const unsigned *hist, bool is_signed, HISTSTATS &st);
+extern	void	constats(const unsigned *hist, CONSTATS &st);
+
+// Write the statistics as a single line of JSON.  If tstamp_us is non-zero,
+// it will be included as the "time" member (in seconds).
+extern	void	histstats_json(FILE *fp, const HISTSTATS &st,
+			uint64_t tstamp_us = 0);
+extern	void	constats_json(FILE *fp, const CONSTATS &st,
+			uint64_t tstamp_us = 0);
+
+#endif	// HISTSTATS_H
@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	i2cbus.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	The interface shared by the two ways of reaching the radio's
+//		I2C bus: bit-banging the GPIO register (I2CGPIO), or the
+//	hardware command FIFO master (I2CCMD).
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	I2CBUS_H
+#define	I2CBUS_H
+
+class	I2CBUS {
+public:
+	// Write msglen bytes of msg to the slave, whose 8-bit (write) address
+	// is given by addr.  Returns zero on success, non-zero if the slave
+	// failed to acknowledge any byte.
+	virtual	int	write(unsigned addr, int msglen, const char *msg) = 0;
+
+	// Read msglen bytes from the slave into msg.  addr is the slave's
+	// 8-bit read address.  Returns zero on success.
+	virtual	int	read(unsigned addr, int msglen, char *msg) = 0;
+
+	virtual	~I2CBUS(void) {}
+};
+
+#endif	// I2CBUS_H
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	i2ccmd.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Runs I2C transactions through the hardware command FIFO
+//		master.  See i2ccmd.h for a description.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+
+#include "i2ccmd.h"
+
+// How many times to read the status register, waiting for the master to go
+// idle, before giving up.  A full FIFO of commands takes about 3ms at 100kHz.
+#define	MAX_POLLS	1000
+
+// run
+// {{{
+// Push the commands into the master's FIFO, no more than a FIFO's worth at a
+// time, and wait for each batch to complete.  Any bytes read are placed into
+// rbuf.  Returns false if a byte wasn't acknowledged, commands were lost, or
+// the master never went idle.
+bool	I2CCMD::run(int ncmds, const unsigned *cmds, char *rbuf) {
+	unsigned	status = 0;
+
+	for(int k=0; k<ncmds; ) {
+		int	n = ncmds - k, nreads = 0, polls = 0;
+
+		if (n > I2CCMD_FIFOLN)
+			n = I2CCMD_FIFOLN;
+		for(int j=0; j<n; j++)
+			if (cmds[k+j] == I2CCMD_READ
+					|| cmds[k+j] == I2CCMD_READN)
+				nreads++;
+
+		m_fpga->writez(m_addr, n, &cmds[k]);
+		k += n;
+
+		// Every status read pops a byte, if there's one to be had
+		do {
+			status = m_fpga->readio(m_addr);
+			if ((status & I2CCMD_VALID) && nreads > 0) {
+				*rbuf++ = status & 0x0ff;
+				nreads--;
+			}
+		} while((status & I2CCMD_BUSY) && ++polls < MAX_POLLS);
+
+		if (status & I2CCMD_BUSY) {
+			fprintf(stderr, "I2C: Master remains busy, status = %08x\n",
+				status);
+			return false;
+		}
+
+		// Collect whatever bytes remain
+		while(nreads > 0) {
+			unsigned	rd[I2CCMD_FIFOLN];
+
+			m_fpga->readz(m_addr, nreads, rd);
+			for(int j=0; j<nreads; j++) {
+				if (0 == (rd[j] & I2CCMD_VALID)) {
+					fprintf(stderr, "I2C: Missing read data\n");
+					return false;
+				} *rbuf++ = rd[j] & 0x0ff;
+			} nreads = 0;
+		}
+	}
+
+	return (status & (I2CCMD_NACK | I2CCMD_OVERFLOW)) == 0;
+}
+// }}}
+
+int	I2CCMD::write(unsigned addr, int msglen, const char *msg) {
+	// {{{
+	unsigned	*cmds = new unsigned[msglen+4];
+	int		ncmds = 0, tries = 0, err = 1;
+
+	cmds[ncmds++] = I2CCMD_CLEAR;
+	cmds[ncmds++] = I2CCMD_START;
+	cmds[ncmds++] = I2CCMD_WRITE(addr);
+	for(int k=0; k<msglen; k++)
+		cmds[ncmds++] = I2CCMD_WRITE(msg[k]);
+	cmds[ncmds++] = I2CCMD_STOP;
+
+	do {
+		if (run(ncmds, cmds, NULL)) {
+			err = 0;
+			break;
+		}
+		printf("I2C: RETRY-WRITE\n");
+	} while(++tries < m_retries);
+
+	delete[] cmds;
+	return err;
+}
+// }}}
+
+int	I2CCMD::read(unsigned addr, int msglen, char *msg) {
+	// {{{
+	unsigned	*cmds = new unsigned[msglen+4];
+	int		ncmds = 0, tries = 0, err = 1;
+
+	cmds[ncmds++] = I2CCMD_CLEAR;
+	cmds[ncmds++] = I2CCMD_START;
+	cmds[ncmds++] = I2CCMD_WRITE(addr);
+	for(int k=0; k<msglen; k++)
+		cmds[ncmds++] = (k+1 < msglen) ? I2CCMD_READ : I2CCMD_READN;
+	cmds[ncmds++] = I2CCMD_STOP;
+
+	do {
+		if (run(ncmds, cmds, msg)) {
+			err = 0;
+			break;
+		}
+		printf("I2C: RETRY-READ\n");
+	} while(++tries < m_retries);
+
+	delete[] cmds;
+	return err;
+}
+// }}}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	i2ccmd.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Drives the radio's I2C bus through the hardware command FIFO
+//		master, rtl/wbi2ccmd.v.  Each transaction is pushed into the
+//	master's FIFO with a single writez(), and then plays out on the wire
+//	without any further help from the host.  The host then only needs to
+//	wait for the master to go idle, and to collect any bytes read.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	I2CCMD_H
+#define	I2CCMD_H
+
+#include "devbus.h"
+#include "i2cbus.h"
+
+// Commands, as written to R_I2CCMD
+// {{{
+#define	I2CCMD_CLEAR		0x000
+#define	I2CCMD_START		0x100
+#define	I2CCMD_STOP		0x200
+#define	I2CCMD_WRITE(B)		(0x300|((B)&0x0ff))
+#define	I2CCMD_READ		0x400
+#define	I2CCMD_READN		0x500
+// }}}
+
+// Status bits, as read from R_I2CCMD
+// {{{
+#define	I2CCMD_BUSY		0x80000000
+#define	I2CCMD_NACK		0x40000000
+#define	I2CCMD_OVERFLOW		0x20000000
+#define	I2CCMD_VALID		0x00000100
+// }}}
+
+// Depth of the master's command FIFO, and its FIFO of bytes read
+#define	I2CCMD_FIFOLN		32
+
+class	I2CCMD : public I2CBUS {
+	DEVBUS		*m_fpga;
+	unsigned	m_addr;		// Address of the master's register
+	int		m_retries;
+
+	bool	run(int ncmds, const unsigned *cmds, char *rbuf);
+public:
+	I2CCMD(DEVBUS *fpga, unsigned addr, int retries = 1)
+		: m_fpga(fpga), m_addr(addr), m_retries(retries) {}
+
+	int	write(unsigned addr, int msglen, const char *msg);
+	int	read(unsigned addr, int msglen, char *msg);
+};
+
+#endif	// I2CCMD_H
@@ -0,0 +1,284 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	i2cgpio.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Compiles I2C transactions into bursts of GPIO register writes.
+//		See i2cgpio.h for a description.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <string.h>
+
+#include "i2cgpio.h"
+
+// GPIO bit assignments
+// {{{
+#define	SCL_BIT		1
+#define	SDA_BIT		2
+
+#define	SCL_INPUT	(SCL_BIT << 16)
+#define	SDA_INPUT	(SDA_BIT << 16)
+
+#define	SET_GPIO(A)	((A<<16)|A)
+#define	CLR_GPIO(A)	(A<<16)
+// }}}
+
+// How many times to poll the GPIO register, waiting for a slave stretching the
+// clock to release SCL, before giving up on the transaction
+#define	MAX_STRETCH_POLLS	1000
+
+// The longest program per byte: eight bits of four steps apiece, plus four
+// for the acknowledgement
+#define	STEPS_PER_BYTE	36
+
+void	I2CGPIO::grow(int len) {
+	// {{{
+	if (len <= m_progsz)
+		return;
+	delete[] m_prog;
+	delete[] m_samples;
+	delete[] m_rd;
+	m_progsz  = (len + 63) & -64;
+	m_prog    = new unsigned[m_progsz];
+	m_samples = new unsigned[m_progsz];
+	m_rd      = new bool[m_progsz];
+}
+// }}}
+
+void	I2CGPIO::sample(void) {
+	// {{{
+	m_rd[m_proglen] = true;
+	m_prog[m_proglen++] = 0;
+	m_nsamples++;
+}
+// }}}
+
+void	I2CGPIO::release_scl(void) {
+	// {{{
+	// Check, following every release of SCL, that the slave let it rise
+	emit(SET_GPIO(SCL_BIT));
+	sample();
+}
+// }}}
+
+void	I2CGPIO::start(void) {
+	// {{{
+	// Both lines are released (high) when idle
+	emit(CLR_GPIO(SDA_BIT));
+	emit(CLR_GPIO(SCL_BIT));
+}
+// }}}
+
+void	I2CGPIO::stop(void) {
+	// {{{
+	emit(CLR_GPIO(SDA_BIT));
+	release_scl();
+	emit(SET_GPIO(SDA_BIT));
+}
+// }}}
+
+void	I2CGPIO::write_byte(unsigned byte) {
+	// {{{
+	for(int k=0; k<8; k++) {
+		if (byte & (128 >> k))
+			emit(SET_GPIO(SDA_BIT));
+		else
+			emit(CLR_GPIO(SDA_BIT));
+		release_scl();
+		emit(CLR_GPIO(SCL_BIT));
+	}
+
+	// Release SDA, and sample the slave's acknowledgement
+	emit(SET_GPIO(SDA_BIT));
+	release_scl();
+	emit(CLR_GPIO(SCL_BIT));
+}
+// }}}
+
+void	I2CGPIO::read_byte(bool ack) {
+	// {{{
+	// SDA has been released by the acknowledgement that came before us
+	for(int k=0; k<8; k++) {
+		release_scl();
+		emit(CLR_GPIO(SCL_BIT));
+	}
+
+	emit((ack) ? CLR_GPIO(SDA_BIT) : SET_GPIO(SDA_BIT));
+	release_scl();
+	emit(CLR_GPIO(SCL_BIT));
+	emit(SET_GPIO(SDA_BIT));
+}
+// }}}
+
+// lines
+// {{{
+// The GPIO value driving both lines as the program left them, once the given
+// step had run
+unsigned	I2CGPIO::lines(int step) const {
+	unsigned	v = SCL_BIT | SDA_BIT;
+
+	for(int k=0; k<=step; k++)
+		if (!m_rd[k])
+			v = (v & ~(m_prog[k] >> 16)) | (m_prog[k] & 0x0ffff);
+
+	return ((SCL_BIT | SDA_BIT) << 16) | v;
+}
+// }}}
+
+// run
+// {{{
+// Run the compiled program, as one mixed series of writes and reads.  Returns
+// false if a slave stretching the clock couldn't be waited out.
+bool	I2CGPIO::run(void) {
+	int	first = 0, ns = 0;
+
+	while(first < m_proglen) {
+		int		k, s = ns, polls = 0;
+		unsigned	v;
+
+		m_fpga->xferz(m_addr, m_proglen-first, &m_rd[first],
+				&m_prog[first], &m_samples[ns]);
+
+		// Look for the first sample taken while SCL was held low
+		for(k=first; k<m_proglen; k++) {
+			if (!m_rd[k])
+				continue;
+			if (0 == (m_samples[s] & SCL_INPUT))
+				break;
+			s++;
+		}
+
+		if (k >= m_proglen)
+			return true;
+
+		// The rest of the program has run since then.  That's only
+		// harmless if the slave has held SCL low all along--in which
+		// case every later sample must have found it low, and so must
+		// the first poll, once SDA is set back to where it was.
+		for(int j=s+1; j<m_nsamples; j++)
+			if (m_samples[j] & SCL_INPUT) {
+				fprintf(stderr, "I2C: Clock stretched, GPIO = %05x\n",
+					m_samples[s]);
+				return false;
+			}
+
+		m_fpga->writeio(m_addr, lines(k));
+		while(0 == ((v = m_fpga->readio(m_addr)) & SCL_INPUT)) {
+			if (++polls >= MAX_STRETCH_POLLS) {
+				fprintf(stderr, "I2C: SCL held low, GPIO = %05x\n",
+					v);
+				m_fpga->writeio(m_addr, SET_GPIO(SCL_BIT|SDA_BIT));
+				return false;
+			}
+		}
+
+		if (polls == 0) {
+			fprintf(stderr, "I2C: Clock stretched, GPIO = %05x\n",
+				m_samples[s]);
+			m_fpga->writeio(m_addr, SET_GPIO(SCL_BIT|SDA_BIT));
+			return false;
+		}
+
+		// SCL has now risen for the sample that found it low.  Take
+		// the sample again, and pick the program up after it.
+		m_samples[s] = v;
+		ns    = s+1;
+		first = k+1;
+	}
+
+	return true;
+}
+// }}}
+
+bool	I2CGPIO::acked(int k) const {
+	return (m_samples[k*9+8] & SDA_INPUT) == 0;
+}
+
+int	I2CGPIO::write(unsigned addr, int msglen, const char *msg) {
+	// {{{
+	int	tries = 0;
+
+	grow(STEPS_PER_BYTE * (msglen+1) + 8);
+	do {
+		bool	err;
+
+		m_proglen = m_nsamples = 0;
+		start();
+		write_byte(addr);
+		for(int k=0; k<msglen; k++)
+			write_byte(msg[k] & 0x0ff);
+		stop();
+
+		err = !run();
+		for(int k=0; !err && k<=msglen; k++)
+			err = !acked(k);
+		if (!err)
+			return 0;
+		printf("I2C: RETRY-WRITE\n");
+	} while(++tries < m_retries);
+
+	return 1;
+}
+// }}}
+
+int	I2CGPIO::read(unsigned addr, int msglen, char *msg) {
+	// {{{
+	int	tries = 0;
+
+	grow(STEPS_PER_BYTE * (msglen+1) + 8);
+	do {
+		m_proglen = m_nsamples = 0;
+		start();
+		write_byte(addr);
+		for(int k=0; k<msglen; k++)
+			read_byte(k+1 < msglen);
+		stop();
+
+		if (run() && acked(0)) {
+			for(int k=0; k<msglen; k++) {
+				unsigned	byte = 0;
+
+				for(int b=0; b<8; b++)
+					byte = (byte << 1)
+					  | ((m_samples[9+k*9+b] & SDA_INPUT)
+						? 1:0);
+				msg[k] = byte;
+			}
+			return 0;
+		}
+		printf("I2C: RETRY-READ\n");
+	} while(++tries < m_retries);
+
+	return 1;
+}
+// }}}
@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	i2cgpio.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	An I2C master, bit-banged through the GPIO register.
+//
+//	Rather than toggling SCL and SDA one bus transaction at a time, and
+//	spinning on the GPIO input between them, each I2C transaction is first
+//	compiled into a program: the list of GPIO values that produce its
+//	start, address, data, acknowledgement and stop phases, interleaved
+//	with a sample of the GPIO inputs following every release of SCL.  The
+//	whole program is then handed to the bus as one mixed series of writes
+//	and reads (DEVBUS::xferz()), so a transaction costs about one round
+//	trip across the debugging bus, rather than a couple of hundred.
+//
+//	Nothing waits on SCL between edges.  Should the slave stretch the
+//	clock, the sample following that release will find SCL still low.
+//	While SCL is held low, the rest of the program can't clock anything
+//	onto the bus.  So long as the slave has held SCL low ever since, the
+//	lines are set back to where they were at that sample, the GPIO
+//	register polled until the slave lets go, that poll taken as the
+//	sample, and the program resumed from there.  Otherwise the transaction
+//	fails, and may be retried.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	I2CGPIO_H
+#define	I2CGPIO_H
+
+#include "devbus.h"
+#include "i2cbus.h"
+
+class	I2CGPIO : public I2CBUS {
+	DEVBUS		*m_fpga;
+	unsigned	m_addr;		// Address of the GPIO register
+	int		m_retries;
+	// The compiled program, which of its steps are samples, and the
+	// samples read while running it.  Data samples are nine to a byte,
+	// the last of which for a byte written is its acknowledgement.
+	unsigned	*m_prog, *m_samples;
+	bool		*m_rd;
+	int		m_proglen, m_nsamples, m_progsz;
+
+	void	grow(int len);
+	void	emit(unsigned v) {
+		m_rd[m_proglen] = false;
+		m_prog[m_proglen++] = v;
+	}
+	void	sample(void);
+	void	release_scl(void);
+	void	start(void);
+	void	stop(void);
+	void	write_byte(unsigned byte);
+	void	read_byte(bool ack);
+	unsigned	lines(int step) const;
+	bool	run(void);
+	bool	acked(int k) const;
+public:
+	I2CGPIO(DEVBUS *fpga, unsigned gpio_addr, int retries = 1)
+		: m_fpga(fpga), m_addr(gpio_addr), m_retries(retries),
+		m_prog(NULL), m_samples(NULL), m_rd(NULL), m_proglen(0),
+		m_nsamples(0), m_progsz(0) {}
+	~I2CGPIO(void) {
+		delete[] m_prog; delete[] m_samples; delete[] m_rd;
+	}
+
+	int	write(unsigned addr, int msglen, const char *msg);
+	int	read(unsigned addr, int msglen, char *msg);
+};
+
+#endif	// I2CGPIO_H
@@ -67,9 +67,13 @@ void	closeup(int v) {
 class	MICSCOPE : public SCOPE {
 public:
 	MICSCOPE(FPGA *fpga, unsigned addr, bool vecread)
-		: SCOPE(fpga, addr, false, false) {};
+		: SCOPE(fpga, addr, false, vecread) {};
 	~MICSCOPE(void) {}
 	virtual	void	decode(DEVBUS::BUSW val) const {
+		decode(stdout, val);
+	}
+
+	virtual	bool	decode(FILE *fp, DEVBUS::BUSW val) const {
 		// {{{
 		// int	trig;
 		int	rf, sample, csn, sck, miso, ce, valid, audioen, rfen,
@@ -86,12 +90,13 @@ public:
 		rfen      = BITV(12);
 		micdata = val & 0x0fff;
 
-		printf("%s%s %s | %s%s (%s%s) -> %s%3x%s | %3x -> %s%s\n",
+		fprintf(fp, "%s%s %s | %s%s (%s%s) -> %s%3x%s | %3x -> %s%s\n",
 			(csn)?"   ":"CSN", (sck)?"SCK":"   ", miso ? "1":"0",
 			(ce) ? "CE":"  ",(valid) ?"VL":"  ",
 			(audioen)?"AU":"--", (rfen)?"RF":"--",
 			(ce)?"0x":"(  ", micdata, (ce)?" ": "?",
 			sample, (rf & 2)?"I":"-", (rf&1)?"Q":"-");
+		return true;
 		// }}}
 	}
 
@@ -121,7 +126,7 @@ int main(int argc, char **argv) {
 
 	m_fpga = new FPGA(new NETCOMMS(host, port));
 
-	MICSCOPE *scope = new MICSCOPE(m_fpga, WBSCOPE, false);
+	MICSCOPE *scope = new MICSCOPE(m_fpga, WBSCOPE, true);
 	scope->set_clkfreq_hz(36000000);
 	if (!scope->ready()) {
 		printf("Scope is not yet ready:\n");
@@ -129,6 +134,7 @@ int main(int argc, char **argv) {
 	} else {
 		scope->print();
 		scope->writevcd("micscope.vcd");
+		scope->writecolumns("micscope.col");
 	}
 	delete	m_fpga;
 }
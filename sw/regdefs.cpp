@@ -55,6 +55,9 @@ const	REGNAME	raw_bregs[] = {
 	{ R_SRATE    ,	"SRATE"     	},
 	{ R_SRATE    ,	"SAMPLERATE"	},
 	{ R_VERSION  ,	"VERSION"   	},
+	{ R_HISTOCC  ,	"HISTOCC"   	},
+	{ R_I2CCMD   ,	"I2CCMD"    	},
+	{ R_I2CCMD   ,	"I2C"       	},
 	{ R_TXFIL    ,	"TXFIL"     	},
 	{ R_TXPSHAPE ,	"TXPSHAPE"  	},
 	{ R_TX2      ,	"TX2"       	},
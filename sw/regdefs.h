@@ -63,6 +63,8 @@
 #define	R_SRATE    	0x00000808	// 00000808, wbregs names: SRATE
 #define	R_SRATE    	0x00000808	// 00000808, wbregs names: SAMPLERATE
 #define	R_VERSION  	0x0000080c	// 0000080c, wbregs names: VERSION
+#define	R_HISTOCC  	0x00000810	// 00000810, wbregs names: HISTOCC
+#define	R_I2CCMD   	0x00000814	// 00000814, wbregs names: I2CCMD, I2C
 #define	R_TXFIL    	0x00000c00	// 00000c00, wbregs names: TXFIL
 #define	R_TXPSHAPE 	0x00000c00	// 00000c00, wbregs names: TXPSHAPE
 #define	R_TX2      	0x00000c04	// 00000c00, wbregs names: TX2
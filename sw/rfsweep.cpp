@@ -0,0 +1,435 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename:	rfsweep.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Steps the SX1257 through a list of frequencies, dwelling a
+//		fixed time at each.  The FRF register values for every
+//	frequency are computed before the sweep starts, and each step then
+//	writes (through the shadow in sx1257.cpp) only those FRF bytes that
+//	differ from the last step.  Every step's deadline is fixed relative to
+//	the start of the sweep, rather than to the end of the last step, so
+//	that a slow step delays only itself.  Once the radio has settled at
+//	each step, the histogram and/or the receiver's carrier and symbol
+//	tracking registers may be captured.  One line of JSON is written per
+//	step.
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+// }}}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "port.h"
+#include "regdefs.h"
+#include "hexbus.h"
+#include "i2cgpio.h"
+#include "i2ccmd.h"
+#include "sx1257.h"
+#include "histread.h"
+#include "histstats.h"
+
+const	int	MAX_I2C_RETRIES = 3;
+
+// The receiver's tracking registers only exist within the QPSK designs
+#if	defined(R_RXSYM) && defined(R_RXCARRIER) && (R_RXCARRIER == R_RXSYM+4)
+#define	HAS_RXREGS
+#endif
+
+typedef	struct	{
+	double		hz;	// The frequency actually tuned to
+	unsigned	frf;	// ... as written to the FRF registers
+} SWEEPSTEP;
+
+FPGA		*m_fpga;
+volatile bool	m_done = false;
+
+void	stopsweep(int v) {
+	m_done = true;
+}
+
+void	usage(void) {
+	printf(
+"USAGE: rfsweep [-n host] [-p port] [-g] [-t] [-d ms] [-w ms] [-l loops]\n"
+"\t\t[-x seed] [-H] [-u] [-R] [-o file] [-f file] [freq ...]\n"
+"\n"
+"\t-n host\tThe network host name of the bus server [%s]\n"
+"\t-p port\tThe network port of the bus server [%d]\n"
+"\t-g\tBit-bang the I2C bus through the GPIO register, rather than\n"
+"\t\tusing the I2C master\n"
+"\t-t\tStep the transmit frequency, rather than the receive frequency\n"
+"\t-d ms\tThe time spent at each frequency [default: 100]\n"
+"\t-w ms\tThe time to wait after tuning before capturing anything\n"
+"\t\t[default: 5]\n"
+"\t-l loops\tThe number of times to step through the list.  Zero\n"
+"\t\truns until interrupted with a ^C.  [default: 1]\n"
+"\t-x seed\tHop through the list in a pseudorandom order, fixed by seed,\n"
+"\t\trather than in the order given\n"
+"\t-H\tCapture a histogram frame at each step, and report its statistics\n"
+"\t-u\tTreat the histogram's bins as unsigned values\n"
+#ifdef	HAS_RXREGS
+"\t-R\tCapture the receiver's RXSYM and RXCARRIER registers at each step\n"
+#endif
+"\t-o file\tWrite the per-step results to file, rather than stdout\n"
+"\t-f file\tRead frequencies from file, one per line, in addition to any\n"
+"\t\tgiven on the command line\n"
+"\n"
+"\tEach frequency is given in Hz, and may carry a k, M, or G suffix.\n"
+"\tA range may be given as start:stop:step, as in 902M:928M:500k.\n",
+		FPGAHOST, FPGAPORT);
+}
+
+// parsehz
+// {{{
+// Parse a frequency, with an optional k, M, or G suffix.  Returns zero if
+// the string isn't a frequency.
+double	parsehz(const char *str, char **end) {
+	char	*ptr;
+	double	hz;
+
+	hz = strtod(str, &ptr);
+	if (ptr == str)
+		return 0.0;
+	switch(*ptr) {
+	case 'k': case 'K': hz *= 1e3; ptr++; break;
+	case 'M':           hz *= 1e6; ptr++; break;
+	case 'G': case 'g': hz *= 1e9; ptr++; break;
+	default: break;
+	}
+
+	if (end)
+		*end = ptr;
+	return hz;
+}
+// }}}
+
+// addfreqs
+// {{{
+// Append a frequency, or a start:stop:step range of frequencies, to the
+// list.  Each is rounded to the nearest FRF step.
+void	addfreqs(const char *spec, SWEEPSTEP *&list, unsigned &nlist,
+		unsigned &nalloc) {
+	char	*ptr;
+	double	start, stop, step;
+
+	start = stop = parsehz(spec, &ptr);
+	step  = 1.0;
+	if (start > 0.0 && *ptr == ':') {
+		stop = parsehz(ptr+1, &ptr);
+		if (*ptr != ':' || (step = parsehz(ptr+1, &ptr)) <= 0.0)
+			step = -1.0;
+	}
+
+	if (start <= 0.0 || stop < start || step <= 0.0
+			|| (*ptr && !isspace(*ptr))) {
+		fprintf(stderr, "ERR: %s is not a frequency, or frequency range\n",
+			spec);
+		exit(EXIT_FAILURE);
+	}
+
+	// Step with an integer count, so that rounding can't drop the last
+	// frequency of the range
+	unsigned	nsteps = (unsigned)((stop - start) / step + 1e-6) + 1;
+	for(unsigned k=0; k<nsteps; k++) {
+		double		hz = start + k * step;
+		unsigned	frf = (unsigned)(hz / SX1257_FSTEP + 0.5);
+
+		if (frf >= (1u<<24)) {
+			fprintf(stderr, "ERR: %.0f Hz is out of the radio's range\n",
+				hz);
+			exit(EXIT_FAILURE);
+		}
+
+		if (nlist >= nalloc) {
+			nalloc = (nalloc < 64) ? 64 : nalloc * 2;
+			list = (SWEEPSTEP *)realloc(list, nalloc*sizeof(SWEEPSTEP));
+			if (NULL == list) {
+				fprintf(stderr, "ERR: Out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		list[nlist].frf = frf;
+		list[nlist].hz  = frf * SX1257_FSTEP;
+		nlist++;
+	}
+}
+// }}}
+
+// sleep_until
+// {{{
+// Sleep until the monotonic clock reaches the given time, in microseconds.
+// Returns immediately if that time has already passed.
+void	sleep_until(uint64_t when_us) {
+	struct timespec	ts;
+
+	ts.tv_sec  = when_us / 1000000ul;
+	ts.tv_nsec = (when_us % 1000000ul) * 1000;
+	while(!m_done && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			&ts, NULL) != 0)
+		;
+}
+// }}}
+
+int main(int argc, char **argv) {
+	const char	*host = FPGAHOST, *out_fname = NULL;
+	int		port = FPGAPORT, skp;
+	bool		gpio_flag = false, tx_flag = false, hist_flag = false,
+			signed_flag = true, rxregs_flag = false, shuffle = false;
+	double		dwell_ms = 100.0, settle_ms = 5.0;
+	unsigned	nloops = 1, seed = 0;
+	SWEEPSTEP	*list = NULL;
+	unsigned	nlist = 0, nalloc = 0;
+	FILE		*fp = stdout;
+
+	// Argument processing
+	// {{{
+	skp=1;
+	for(int argn=0; argn<argc-skp; argn++) {
+		if (argv[argn+skp][0] == '-') {
+			if (argv[argn+skp][1] == 'g') {
+				gpio_flag = true;
+			} else if (argv[argn+skp][1] == 't') {
+				tx_flag = true;
+			} else if (argv[argn+skp][1] == 'H') {
+				hist_flag = true;
+			} else if (argv[argn+skp][1] == 'u') {
+				signed_flag = false;
+#ifdef	HAS_RXREGS
+			} else if (argv[argn+skp][1] == 'R') {
+				rxregs_flag = true;
+#endif
+			} else if (argv[argn+skp][1]
+					&& strchr("npdwlxof", argv[argn+skp][1])) {
+				char	opt = argv[argn+skp][1];
+
+				if (argn+skp+1 >= argc) {
+					fprintf(stderr, "ERR: -%c requires an argument\n", opt);
+					usage();
+					exit(EXIT_FAILURE);
+				}
+				const char *val = argv[argn+skp+1];
+
+				switch(opt) {
+				case 'n': host = val; break;
+				case 'p': port = atoi(val); break;
+				case 'd': dwell_ms = atof(val); break;
+				case 'w': settle_ms = atof(val); break;
+				case 'l': nloops = atoi(val); break;
+				case 'x': shuffle = true;
+					seed = strtoul(val, NULL, 0); break;
+				case 'o': out_fname = val; break;
+				case 'f': {
+					// {{{
+					FILE	*ffp;
+					char	line[256];
+
+					if (NULL == (ffp = fopen(val, "r"))) {
+						fprintf(stderr, "ERR: Could not open %s\n", val);
+						exit(EXIT_FAILURE);
+					}
+					while(fgets(line, sizeof(line), ffp)) {
+						char *ptr = line;
+						while(isspace(*ptr))
+							ptr++;
+						if (*ptr == '\0' || *ptr == '#')
+							continue;
+						addfreqs(ptr, list, nlist, nalloc);
+					} fclose(ffp);
+					} break;
+					// }}}
+				} skp++;	// The option's value
+			} else {
+				usage();
+				exit(EXIT_SUCCESS);
+			}
+			skp++; argn--;
+		} else
+			argv[argn] = argv[argn+skp];
+	} argc -= skp;
+
+	for(int argn=0; argn<argc; argn++)
+		addfreqs(argv[argn], list, nlist, nalloc);
+	// }}}
+
+	if (nlist == 0) {
+		usage();
+		exit(EXIT_FAILURE);
+	} if (dwell_ms <= 0.0 || settle_ms < 0.0 || settle_ms >= dwell_ms) {
+		fprintf(stderr, "ERR: The settling time must be less than the dwell\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (shuffle) {
+		// Fisher-Yates, from a fixed seed, so that the hop order is
+		// repeatable from one run to the next
+		srand48(seed);
+		for(unsigned k=nlist-1; k>0; k--) {
+			unsigned	j = (unsigned)(drand48() * (k+1));
+			SWEEPSTEP	tmp = list[k];
+
+			list[k] = list[j];
+			list[j] = tmp;
+		}
+	}
+
+	if (out_fname && NULL == (fp = fopen(out_fname, "w"))) {
+		fprintf(stderr, "ERR: Could not open %s\n", out_fname);
+		exit(EXIT_FAILURE);
+	}
+
+	m_fpga = new FPGA(new NETCOMMS(host, port));
+	I2CBUS	*i2c;
+	if (gpio_flag)
+		i2c = new I2CGPIO(m_fpga, R_GPIO, MAX_I2C_RETRIES);
+	else
+		i2c = new I2CCMD(m_fpga, R_I2CCMD, MAX_I2C_RETRIES);
+	SX1257		sx(i2c);
+	HISTREADER	reader(m_fpga);
+	unsigned	*hbuf = NULL;
+	const unsigned	frfreg = (tx_flag) ? RF_REGFRFTXMSB : RF_REGFRFRXMSB;
+
+	// Read the radio once, so every step after this one need only write
+	// the FRF bytes that change
+	if (sx.load()) {
+		fprintf(stderr, "ERR: Could not read the radio's registers\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (hist_flag) {
+		hbuf = new unsigned[HISTREAD_NBINS];
+		reader.set_abort(&m_done);
+		// Don't wait on the interrupt past the end of the dwell
+		reader.set_timeout((unsigned)(dwell_ms - settle_ms));
+	}
+
+	signal(SIGINT, stopsweep);
+
+	const uint64_t	dwell_us  = (uint64_t)(dwell_ms  * 1000.0);
+	const uint64_t	settle_us = (uint64_t)(settle_ms * 1000.0);
+	uint64_t	t0, nsteps = 0, max_late = 0, total_tune = 0;
+
+	t0 = monotonic_us();
+	for(unsigned loop=0; !m_done && (nloops == 0 || loop < nloops); loop++)
+	for(unsigned k=0; !m_done && k<nlist; k++) {
+		const uint64_t	deadline = t0 + nsteps * dwell_us;
+		uint64_t	start_us, tuned_us, tstamp, late;
+		unsigned	nbytes;
+
+		sleep_until(deadline);
+		if (m_done)
+			break;
+
+		// Tune
+		// {{{
+		start_us = monotonic_us();
+		tstamp   = wallclock_us();
+		nbytes   = sx.bytes_written();
+		sx.set(frfreg, list[k].frf, 3);
+		if (sx.commit()) {
+			fprintf(stderr, "ERR: Radio register write failed, at %.1f Hz\n",
+				list[k].hz);
+			exit(EXIT_FAILURE);
+		}
+		tuned_us = monotonic_us();
+		nbytes   = sx.bytes_written() - nbytes;
+
+		late = start_us - deadline;
+		if (late > max_late)
+			max_late = late;
+		total_tune += tuned_us - start_us;
+		// }}}
+
+		fprintf(fp, "{\"step\":%lu,\"loop\":%u,\"freq\":%.1f,\"frf\":%u,"
+			"\"time\":%lu.%06lu,\"late_us\":%lu,\"tune_us\":%lu,"
+			"\"bytes\":%u",
+			(unsigned long)nsteps, loop, list[k].hz, list[k].frf,
+			(unsigned long)(tstamp / 1000000ul),
+			(unsigned long)(tstamp % 1000000ul),
+			(unsigned long)late,
+			(unsigned long)(tuned_us - start_us), nbytes);
+
+		if (hist_flag || rxregs_flag)
+			sleep_until(deadline + settle_us);
+
+		if (hist_flag && !m_done) {
+			// {{{
+			HISTSTATS	st;
+			unsigned	flags;
+
+			flags = reader.read_frame(hbuf);
+			histstats(hbuf, signed_flag, st);
+			fprintf(fp, ",\"hflags\":%u,\"total\":%lu,\"mean\":%.4f,"
+				"\"stddev\":%.4f,\"median\":%d,\"clipped\":%.6f",
+				flags, (unsigned long)st.total, st.mean,
+				st.stddev, st.pct[HISTSTATS_MEDIAN], st.clipped);
+			// }}}
+		}
+
+#ifdef	HAS_RXREGS
+		if (rxregs_flag && !m_done) {
+			// {{{
+			DEVBUS::BUSW	rxregs[2];
+
+			// Both registers, in a single burst
+			m_fpga->readi(R_RXSYM, 2, rxregs);
+			fprintf(fp, ",\"rxsym\":%u,\"rxcarrier\":%u",
+				rxregs[0], rxregs[1]);
+			// }}}
+		}
+#endif
+
+		fprintf(fp, "}\n");
+		nsteps++;
+	}
+
+	if (fp != stdout)
+		fclose(fp);
+	else
+		fflush(fp);
+
+	if (nsteps > 0)
+		fprintf(stderr, "%lu steps, %u register bytes written in %u writes, "
+			"mean tune %.1f us, worst late %lu us\n",
+			(unsigned long)nsteps, sx.bytes_written(), sx.writes(),
+			(double)total_tune / nsteps, (unsigned long)max_late);
+
+	delete[]	hbuf;
+	free(list);
+	delete	i2c;
+	delete	m_fpga;
+	return EXIT_SUCCESS;
+}
@@ -47,10 +47,17 @@
 #include <signal.h>
 #include <assert.h>
 #include <time.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "devbus.h"
 #include "scopecls.h"
 
+// Formatting work is split into chunks of no fewer than this many words
+#define	SCOPE_MIN_FORMAT_CHUNK	4096
+
 bool	SCOPE::ready() {
 	// {{{
 	unsigned v;
@@ -112,26 +119,135 @@ int	SCOPE::scoplen(void) {
 	// }}}
 }
 
+void	SCOPE::arm(void) {
+	// {{{
+	// Writing the holdoff to the control register, with the top (reset)
+	// bit clear, resets the scope and starts a new capture.
+	scoplen();
+	m_fpga->writeio(m_addr, m_holdoff);
+
+	release();
+	// }}}
+}
+
+bool	SCOPE::capture(void) {
+	// {{{
+	if (!ready())
+		return false;
+
+	release();
+
+	return rawread();
+} // }}}
+
+void	SCOPE::release(void) {
+	// {{{
+	if (m_data) {
+		m_pool.push_back(m_data);
+		m_data = NULL;
+	}
+} // }}}
+
+void	SCOPE::preallocate(unsigned nbuffers) {
+	// {{{
+	if (scoplen() == 0)
+		return;
+
+	// Reserve room for every buffer we might hold, so that release()
+	// never needs to grow the pool either
+	m_pool.reserve(nbuffers + 1);
+	while(m_pool.size() < nbuffers)
+		m_pool.push_back(new DEVBUS::BUSW[m_scoplen]);
+} // }}}
+
+DEVBUS::BUSW	*SCOPE::getbuffer(void) {
+	// {{{
+	DEVBUS::BUSW	*buf;
+
+	if (m_pool.size() == 0)
+		return new DEVBUS::BUSW[m_scoplen];
+
+	buf = m_pool.back();
+	m_pool.pop_back();
+	return buf;
+} // }}}
+
+// Control register bits used to verify a vector read
+#define	SCOPE_RESET	0x80000000
+#define	SCOPE_STOPPED	0x40000000
+#define	SCOPE_CFGBITS	0x0c000000	// Manual trigger, and disable trigger
+#define	SCOPE_ZERO	0x02000000
+
+bool	SCOPE::rewind(void) {
+	// {{{
+	DEVBUS::BUSW	ctl;
+
+	try {
+		// Writing to the control register with the reset bit set
+		// returns the read pointer to zero, but doesn't otherwise
+		// reset the scope.  Keep the trigger configuration bits as
+		// they were.
+		ctl = m_fpga->readio(m_addr);
+		m_fpga->writeio(m_addr, SCOPE_RESET | (ctl & SCOPE_CFGBITS));
+		ctl = m_fpga->readio(m_addr);
+	} catch(BUSERR b) {
+		m_fpga->reset_err();
+		return false;
+	}
+
+	return ((ctl & (SCOPE_ZERO|SCOPE_STOPPED))==(SCOPE_ZERO|SCOPE_STOPPED));
+} // }}}
+
+bool	SCOPE::readchunk(unsigned pos, unsigned len, DEVBUS::BUSW *buf,
+		DEVBUS::BUSW ctl) {
+	// {{{
+	DEVBUS::BUSW	now;
+	bool		wrapped = (((pos + len) & (m_scoplen-1)) == 0);
+
+	try {
+		m_fpga->readz(m_addr+4, len, buf);
+		now = m_fpga->readio(m_addr);
+	} catch(BUSERR b) {
+		m_fpga->reset_err();
+		return false;
+	}
+
+	// Nothing about the capture may have changed while we were reading.
+	if ((now & ~SCOPE_ZERO) != (ctl & ~SCOPE_ZERO))
+		return false;
+
+	// The ZERO bit is our only view of the scope's read pointer.  It must
+	// be set if (and only if) we just read the last word of the buffer.
+	if (((now & SCOPE_ZERO) != 0) != wrapped)
+		return false;
+
+	return true;
+} // }}}
+
 //
 // rawread
 // {{{
-// Read the scope data from the scope.
-void	SCOPE::rawread(void) {
+// Read the scope data from the scope.  Returns true if m_data now holds a
+// complete capture.  On any failure, the partial buffer is returned to the
+// pool and m_data is left NULL.
+bool	SCOPE::rawread(void) {
+	DEVBUS::BUSW	ctl;
+
 	// If we've already read the data from the scope, then we don't need
 	// to read it a second time.
 	if (m_data)
-		return;
+		return true;
 
 	// Let's get the length of the scope, and check that it is a valid
 	// length
 	if (scoplen() <= 4) {
 		printf("ERR: Scope has less than a minimum length.  Is it truly a scope?\n");
-		return;
+		return false;
 	}
 
-	// Now that we know the size of the scopes buffer, let's allocate a
+	// Now that we know the size of the scopes buffer, let's grab a
 	// buffer to hold all this data
-	m_data = new DEVBUS::BUSW[m_scoplen];
+	m_data = getbuffer();
 
 	// There are two means of reading from a DEVBUS interface: The first
 	// is a vector read, optimized so that the address and read command
@@ -141,60 +257,268 @@ void	SCOPE::rawread(void) {
 	// If the bus works, you'll want to use readz(): read scoplen values
 	// into the buffer, from the address WBSCOPEDATA, without incrementing
 	// the address each time (hence the 'z' in readz--for zero increment).
-	if (m_vector_read) {
-		m_fpga->readz(m_addr+4, m_scoplen, m_data);
-	} else {
+	if (!m_vector_read) {
 		for(unsigned int i=0; i<m_scoplen; i++)
 			m_data[i] = m_fpga->readio(m_addr+4);
+		return true;
+	}
+
+	// Vector reads are broken into chunks.  After every chunk, we check
+	// the control register to make certain the scope is still stopped,
+	// still holds the same capture, and that its read pointer is where
+	// we expect it to be.  If not, we rewind the scope, skip forward to
+	// the failed chunk, and try that chunk again.
+	ctl = m_fpga->readio(m_addr);
+	if ((ctl & SCOPE_ZERO)==0) {
+		// Someone's already been reading from this scope.  Start
+		// over from the beginning.
+		if (!rewind()) {
+			fprintf(stderr, "ERR: Could not rewind scope\n");
+			release();
+			return false;
+		} ctl = m_fpga->readio(m_addr);
+	}
+
+	for(unsigned pos=0; pos<m_scoplen; pos += m_chunklen) {
+		unsigned	ln = m_scoplen - pos, tries = 0;
+
+		if (ln > m_chunklen)
+			ln = m_chunklen;
+
+		bool	ok = readchunk(pos, ln, &m_data[pos], ctl);
+
+		while(!ok) {
+			if (++tries > m_maxretries) {
+				fprintf(stderr, "ERR: Scope read failed at word %d, giving up\n", pos);
+				release();
+				return false;
+			}
+
+			fprintf(stderr, "WARNING: Scope read failed at word %d, retrying\n", pos);
+
+			// Return to where this chunk started.  The words
+			// before it have already been verified, so we just
+			// read them (again) into the chunk's own buffer space
+			// and discard them.
+			ok = rewind();
+			if (ok) try {
+				for(unsigned skp=0; skp<pos; skp += ln)
+					m_fpga->readz(m_addr+4,
+						(pos-skp < ln) ? pos-skp : ln,
+						&m_data[pos]);
+			} catch(BUSERR b) {
+				m_fpga->reset_err();
+				ok = false;
+			}
+
+			ok = ok && readchunk(pos, ln, &m_data[pos], ctl);
+		}
 	}
+
+	return true;
 } // }}}
 
-void	SCOPE::print(void) {
+void	SCOPE::format_chunks(FILE *fp, CHUNKFN fn, long offset,
+		unsigned long alen, bool count_first_run, bool parallel) {
 	// {{{
-	unsigned long addrv = 0, alen;
-	int	offset;
+	unsigned	nchunks, chunklen, nthreads, window;
+	std::vector<unsigned long>	addrv;
 
-	rawread();
+	// Split the buffer into chunks, several per thread so that threads
+	// finishing early have something else to do.
+	// {{{
+	nthreads = (parallel) ? m_nthreads : 1;
+	chunklen = m_scoplen / (nthreads * 4);
+	if (chunklen < SCOPE_MIN_FORMAT_CHUNK)
+		chunklen = SCOPE_MIN_FORMAT_CHUNK;
+	nchunks = (m_scoplen + chunklen - 1) / chunklen;
+	if (nchunks < 1)
+		nchunks = 1;
+	// }}}
 
-	// Count how many values are in our (possibly compressed) buffer.
-	// If it weren't for the compression, this'd be m_scoplen
-	alen = getaddresslen();
+	// For compressed scopes, find the address each chunk starts at.  This
+	// is the only state carried from one word to the next.
+	// {{{
+	addrv.resize(nchunks, 0);
+	if (m_compressed) {
+		unsigned long	a = 0;
 
-	// If the holdoff is zero, the triggered item is the very
-	// last one.
-	offset = alen - m_holdoff -1;
+		for(unsigned i=0; i<m_scoplen; i++) {
+			if ((i % chunklen) == 0)
+				addrv[i / chunklen] = a;
+			if ((m_data[i]>>31)&1) {
+				if ((i != 0)||(count_first_run))
+					a += (m_data[i]&0x7fffffff) + 1;
+			} else
+				a++;
+		}
+	}
+	// }}}
+
+	if ((nthreads <= 1)||(nchunks <= 1)) {
+		// Nothing to be gained by threading, just do it all here
+		for(unsigned c=0; c<nchunks; c++) {
+			unsigned end = (c+1) * chunklen;
+			if (end > m_scoplen)
+				end = m_scoplen;
+			(this->*fn)(fp, c*chunklen, end, addrv[c], offset, alen);
+		}
+		return;
+	}
+
+	// Hand the chunks out to our threads.  Each formats into its own
+	// memory stream.  The calling thread then writes each chunk out, in
+	// order, as it completes.  Threads are kept from getting more than
+	// a window's worth of chunks ahead of the writer, to keep memory in
+	// check.
+	// {{{
+	std::vector<char *>	bufs(nchunks, (char *)NULL);
+	std::vector<size_t>	lens(nchunks, 0);
+	std::vector<bool>	done(nchunks, false);
+	std::vector<std::thread> pool;
+	std::mutex		mtx;
+	std::condition_variable	cv;
+	unsigned		next = 0, written = 0;
+
+	window = nthreads * 2;
+	for(unsigned t=0; t<nthreads; t++) {
+		pool.push_back(std::thread([&]() {
+			for(;;) {
+				unsigned	c, end;
+				FILE		*mfp;
+
+				{
+					std::unique_lock<std::mutex> lk(mtx);
+					cv.wait(lk, [&]() {
+						return (next >= nchunks)
+							||(next < written + window);
+					});
+					if (next >= nchunks)
+						return;
+					c = next++;
+				}
+
+				end = (c+1) * chunklen;
+				if (end > m_scoplen)
+					end = m_scoplen;
+				mfp = open_memstream(&bufs[c], &lens[c]);
+				if (mfp) {
+					(this->*fn)(mfp, c*chunklen, end,
+						addrv[c], offset, alen);
+					fclose(mfp);
+				}
+
+				{
+					std::unique_lock<std::mutex> lk(mtx);
+					done[c] = true;
+				}
+				cv.notify_all();
+			}
+		}));
+	}
+
+	for(unsigned c=0; c<nchunks; c++) {
+		{
+			std::unique_lock<std::mutex> lk(mtx);
+			cv.wait(lk, [&]() { return (bool)done[c]; });
+		}
+
+		if (bufs[c]) {
+			fwrite(bufs[c], 1, lens[c], fp);
+			free(bufs[c]);
+			bufs[c] = NULL;
+		}
+
+		{
+			std::unique_lock<std::mutex> lk(mtx);
+			written = c+1;
+		}
+		cv.notify_all();
+	}
 
+	for(unsigned t=0; t<nthreads; t++)
+		pool[t].join();
+	// }}}
+} // }}}
+
+void	SCOPE::print_chunk(FILE *fp, unsigned start, unsigned end,
+		unsigned long addrv, long offset, unsigned long alen) {
+	// {{{
 	if(m_compressed) {
-		for(int i=0; i<(int)m_scoplen; i++) {
+		for(unsigned i=start; i<end; i++) {
 			if ((m_data[i]>>31)&1) {
 				addrv += (m_data[i]&0x7fffffff) + 1;
-				printf(" ** (+0x%08x = %8d)\n",
+				fprintf(fp, " ** (+0x%08x = %8d)\n",
 					(m_data[i]&0x07fffffff),
 					(m_data[i]&0x07fffffff));
 				continue;
 			}
-			printf("%10ld %08x: ", addrv++, m_data[i]);
-			decode(m_data[i]);
-			if ((int)addrv == offset)
-				printf(" <--- TRIGGER");
-			printf("\n");
+			fprintf(fp, "%10ld %08x: ", addrv++, m_data[i]);
+			if (!decode(fp, m_data[i]))
+				decode(m_data[i]);
+			if ((long)addrv == offset)
+				fprintf(fp, " <--- TRIGGER");
+			fprintf(fp, "\n");
 		}
 	} else {
-		for(int i=0; i<(int)m_scoplen; i++) {
-			if ((i>0)&&(m_data[i] == m_data[i-1])&&(i<(int)(m_scoplen-1))) {
+		for(unsigned i=start; i<end; i++) {
+			// Repeated lines are skipped.  Since this depends only
+			// upon the data around us, and not on anything we've
+			// printed, it works the same regardless of where our
+			// chunk starts.
+			if ((i>0)&&(m_data[i] == m_data[i-1])&&(i<m_scoplen-1)) {
 				if ((i>2)&&(m_data[i] != m_data[i-2]))
-					printf(" **** ****\n");
+					fprintf(fp, " **** ****\n");
 				continue;
-			} printf("%9d %08x: ", i, m_data[i]);
-			decode(m_data[i]);
+			} fprintf(fp, "%9d %08x: ", i, m_data[i]);
+			if (!decode(fp, m_data[i]))
+				decode(m_data[i]);
 
-			if (i == offset)
-				printf(" <--- TRIGGER");
-			printf("\n");
+			if ((long)i == offset)
+				fprintf(fp, " <--- TRIGGER");
+			fprintf(fp, "\n");
 		}
 	}
 } // }}}
 
+void	SCOPE::print(void) {
+	// {{{
+	unsigned long alen;
+	long	offset;
+	bool	parallel;
+
+	rawread();
+	if (!m_data)
+		return;
+
+	// Count how many values are in our (possibly compressed) buffer.
+	// If it weren't for the compression, this'd be m_scoplen
+	alen = getaddresslen();
+
+	// If the holdoff is zero, the triggered item is the very
+	// last one.
+	offset = alen - m_holdoff -1;
+
+	// We can only split this work across threads if our decode() can
+	// write to a FILE * other than stdout.  Try it once to find out.
+	{
+		char	*tbuf = NULL;
+		size_t	tlen = 0;
+		FILE	*tfp = open_memstream(&tbuf, &tlen);
+
+		parallel = (tfp != NULL) && decode(tfp, m_data[0]);
+		if (tfp)
+			fclose(tfp);
+		free(tbuf);
+	}
+
+	fflush(stdout);
+	format_chunks(stdout, &SCOPE::print_chunk, offset, alen, true,
+			parallel);
+	fflush(stdout);
+} // }}}
+
+
 void	SCOPE::write_trace_timescale(FILE *fp) {
 	fprintf(fp, "$timescale 1ns $end\n\n");
 }
@@ -238,7 +562,7 @@ void	SCOPE::write_trace_header(FILE *fp, int offset) {
 	fprintf(fp, "  $var wire %2d \'T _trigger $end\n", 1);
 
 	for(unsigned i=0; i<m_traces.size(); i++) {
-		TRACEINFO *info = m_traces[i];
+		const TRACEINFO *info = &m_traces[i];
 		fprintf(fp, "  $var wire %2d %s %s",
 			info->m_nbits, info->m_key, info->m_name);
 		if ((info->m_nbits != 1)&&(NULL != strchr(info->m_name, '[')))
@@ -266,7 +590,8 @@ void	SCOPE::write_binary_trace(FILE *fp, const int nbits, unsigned val,
 	fprintf(fp, " %s\n", str);
 } // }}}
 
-void	SCOPE::write_binary_trace(FILE *fp, TRACEINFO *info, unsigned value) {
+void	SCOPE::write_binary_trace(FILE *fp, const TRACEINFO *info,
+		unsigned value) {
 	write_binary_trace(fp, info->m_nbits, (value>>info->m_nshift),
 		info->m_key);
 }
@@ -274,22 +599,22 @@ void	SCOPE::write_binary_trace(FILE *fp, TRACEINFO *info, unsigned value) {
 void	SCOPE::register_trace(const char *name,
 		unsigned nbits, unsigned shift) {
 	// {{{
-	TRACEINFO	*info = new TRACEINFO;
+	TRACEINFO	info;
 	int	nkey = m_traces.size();
 
-	info->m_name   = name;
-	info->m_nbits  = nbits;
-	info->m_nshift = shift;
+	info.m_name   = name;
+	info.m_nbits  = nbits;
+	info.m_nshift = shift;
 
-	info->m_key[0] = 'v';
+	info.m_key[0] = 'v';
 	if (nkey < 26)
-		info->m_key[1] = 'a'+nkey;
+		info.m_key[1] = 'a'+nkey;
 	else if (nkey < 26+26)
-		info->m_key[1] = 'A'+nkey-26;
+		info.m_key[1] = 'A'+nkey-26;
 	else // if (nkey < 26+26+10)	// Should never happen
-		info->m_key[1] = '0'+nkey-26-26;
-	info->m_key[2] = '\0';
-	info->m_key[3] = '\0';
+		info.m_key[1] = '0'+nkey-26-26;
+	info.m_key[2] = '\0';
+	info.m_key[3] = '\0';
 
 	m_traces.push_back(info);
 } // }}}
@@ -327,41 +652,21 @@ unsigned	SCOPE::getaddresslen(void) {
  */
 void	SCOPE::define_traces(void) {}
 
-void	SCOPE::writevcd(FILE *fp) {
+void	SCOPE::vcd_chunk(FILE *fp, unsigned start, unsigned end,
+		unsigned long addrv, long offset, unsigned long alen) {
 	// {{{
-	unsigned	alen;
-	int	offset = 0;
-
-	if (!m_data)
-		rawread();
-
-	// If the traces haven't yet been defined, then define them now.
-	if (m_traces.size()==0)
-		define_traces();
-
-	// Count how many values are in our (possibly compressed) buffer.
-	// If it weren't for the compression, this'd be m_scoplen
-	alen = getaddresslen();
-
-	// If the holdoff is zero, the triggered item is the very
-	// last one.
-	offset = alen - m_holdoff -1;
-
-	// Write the file header.
-	write_trace_header(fp, offset);
-
 	// And split into two paths--one for compressed scopes (wbscopc), and
 	// the other for the more normal scopes (wbscope).
 	if(m_compressed) {
 		// With compressed scopes, you need to track the address
-		// relative to the beginning.
-		unsigned long	addrv = 0;
+		// relative to the beginning.  Our caller has already done
+		// this for every word prior to start.
 		unsigned long	now_ns;
 		double		dnow;
 		bool		last_trigger = true;
 
 		// Loop over each data word read from the scope
-		for(int i=0; i<(int)m_scoplen; i++) {
+		for(unsigned i=start; i<end; i++) {
 			// If the high bit is set, the address jumps by more
 			// than an increment
 			if ((m_data[i]>>31)&1) {
@@ -392,7 +697,7 @@ void	SCOPE::writevcd(FILE *fp) {
 
 			fprintf(fp, "#%ld\n", now_ns);
 
-			if ((int)(addrv-alen) == offset) {
+			if ((long)(addrv-alen) == offset) {
 				fprintf(fp, "1\'T\n");
 				last_trigger = true;
 			} else if (last_trigger)
@@ -406,8 +711,8 @@ void	SCOPE::writevcd(FILE *fp) {
 			// Finally, walk through all of the user defined traces,
 			// writing each to the VCD file.
 			for(unsigned k=0; k<m_traces.size(); k++) {
-				TRACEINFO *info = m_traces[k];
-				write_binary_trace(fp, info, m_data[i]);
+				write_binary_trace(fp, &m_traces[k],
+								m_data[i]);
 			}
 
 			addrv++;
@@ -424,7 +729,7 @@ void	SCOPE::writevcd(FILE *fp) {
 		// that clock within here.
 
 		// Loop over all data words
-		for(int i=0; i<(int)m_scoplen; i++) {
+		for(unsigned i=start; i<end; i++) {
 			// Positive edge of the clock (everything is assumed to
 			// be on the positive edge)
 
@@ -442,14 +747,14 @@ void	SCOPE::writevcd(FILE *fp) {
 			write_binary_trace(fp, (m_compressed)?31:32,
 				m_data[i], "\'R\n");
 
-			if (i == offset)
+			if ((long)i == offset)
 				fprintf(fp, "1\'T\n");
 			else // if (addrv == offset+1)
 				fprintf(fp, "0\'T\n");
 
 			for(unsigned k=0; k<m_traces.size(); k++) {
-				TRACEINFO *info = m_traces[k];
-				write_binary_trace(fp, info, m_data[i]);
+				write_binary_trace(fp, &m_traces[k],
+								m_data[i]);
 			}
 
 			//
@@ -467,6 +772,35 @@ void	SCOPE::writevcd(FILE *fp) {
 	}
 } // }}}
 
+void	SCOPE::writevcd(FILE *fp) {
+	// {{{
+	unsigned	alen;
+	int	offset = 0;
+
+	if (!m_data)
+		rawread();
+	if (!m_data)
+		return;
+
+	// If the traces haven't yet been defined, then define them now.
+	if (m_traces.size()==0)
+		define_traces();
+
+	// Count how many values are in our (possibly compressed) buffer.
+	// If it weren't for the compression, this'd be m_scoplen
+	alen = getaddresslen();
+
+	// If the holdoff is zero, the triggered item is the very
+	// last one.
+	offset = alen - m_holdoff -1;
+
+	// Write the file header.
+	write_trace_header(fp, offset);
+
+	// Then the body, split across as many threads as we have
+	format_chunks(fp, &SCOPE::vcd_chunk, offset, alen, false, true);
+} // }}}
+
 /*
  * writevcd
  * {{{
@@ -488,3 +822,212 @@ void	SCOPE::writevcd(const char *trace_file_name) {
 	fclose(fp);
 } // }}}
 
+
+/*
+ * unpack_column
+ * {{{
+ * Split one trace out of every word in src[], placing the result into dst[].
+ * This is the inner loop of the columnar export, and so it is written as a
+ * simple shift and mask over the whole buffer--something the compiler can
+ * vectorize.
+ */
+template <class T> static void unpack_column(T *dst, const uint32_t *src,
+		const unsigned n, const unsigned shift, const unsigned nbits,
+		const bool sign_extend) {
+	if (sign_extend && (nbits > 1) && (nbits < 32)) {
+		const unsigned	up = 32 - nbits;
+
+		for(unsigned i=0; i<n; i++)
+			dst[i] = (T)(((int32_t)((src[i] >> shift) << up)) >> up);
+	} else {
+		const uint32_t	mask = (nbits >= 32) ? 0xffffffffu
+						: ((1u << nbits)-1);
+
+		for(unsigned i=0; i<n; i++)
+			dst[i] = (T)((src[i] >> shift) & mask);
+	}
+} // }}}
+
+static	size_t	align_up(size_t v) {
+	return (v + SCOPECOL_ALIGN-1) & (-(size_t)SCOPECOL_ALIGN);
+}
+
+/*
+ * write_padded
+ * {{{
+ * Write len bytes of buf to fp, followed by enough zeros to bring the file
+ * up to the next SCOPECOL_ALIGN boundary.  pos is the current file offset,
+ * and is updated to the new one.  Returns false on any write error.
+ */
+static	bool	write_padded(FILE *fp, const void *buf, size_t len,
+			size_t &pos) {
+	static const char zeros[SCOPECOL_ALIGN] = { 0 };
+	size_t	pad = align_up(pos + len) - (pos + len);
+
+	if ((len > 0)&&(fwrite(buf, 1, len, fp) != len))
+		return false;
+	if ((pad > 0)&&(fwrite(zeros, 1, pad, fp) != pad))
+		return false;
+	pos += len + pad;
+	return true;
+} // }}}
+
+bool	SCOPE::writecolumns(FILE *fp, bool sign_extend) {
+	// {{{
+	SCOPECOL_HEADER	hdr;
+	SCOPECOL_COLUMN	*cols;
+	uint32_t	*rows;
+	uint64_t	*tcol;
+	unsigned	nrows, ncols, alen, maxw;
+	size_t		offset;
+	char		*cbuf;
+	bool		ok = true;
+
+	if (!m_data)
+		rawread();
+	if (!m_data)
+		return false;
+
+	if (m_traces.size()==0)
+		define_traces();
+
+	alen = getaddresslen();
+
+	// Gather the rows, and the time associated with each.  For an
+	// uncompressed scope, this is just a copy.  For a compressed scope,
+	// we drop the run-length words, folding them into the time column
+	// instead.
+	// {{{
+	rows = new uint32_t[m_scoplen];
+	tcol = new uint64_t[m_scoplen];
+	nrows = 0;
+	if (m_compressed) {
+		uint64_t	addrv = 0;
+
+		for(unsigned i=0; i<m_scoplen; i++) {
+			if ((m_data[i]>>31)&1) {
+				if (i != 0)
+					addrv += (m_data[i]&0x7fffffff) + 1;
+				continue;
+			}
+
+			rows[nrows] = m_data[i];
+			tcol[nrows] = addrv++;
+			nrows++;
+		}
+	} else {
+		for(unsigned i=0; i<m_scoplen; i++) {
+			rows[i] = m_data[i];
+			tcol[i] = i;
+		} nrows = m_scoplen;
+	}
+	// }}}
+
+	// Build the header and the column descriptors
+	// {{{
+	ncols = m_traces.size() + 2;
+	cols  = new SCOPECOL_COLUMN[ncols];
+	memset(cols, 0, sizeof(SCOPECOL_COLUMN) * ncols);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.m_magic, SCOPECOL_MAGIC, sizeof(hdr.m_magic));
+	hdr.m_version    = SCOPECOL_VERSION;
+	hdr.m_hdrlen     = sizeof(SCOPECOL_HEADER);
+	hdr.m_ncols      = ncols;
+	hdr.m_nrows      = nrows;
+	hdr.m_clkfreq_hz = m_clkfreq_hz;
+	hdr.m_flags      = (m_compressed) ? SCOPECOL_COMPRESSED : 0;
+	// If the holdoff is zero, the triggered item is the very last one
+	hdr.m_trigger    = alen - m_holdoff - 1;
+
+	strcpy(cols[0].m_name, "_time");
+	cols[0].m_nbits = 64; cols[0].m_width = sizeof(uint64_t);
+	strcpy(cols[1].m_name, "_raw");
+	cols[1].m_nbits = (m_compressed) ? 31 : 32;
+	cols[1].m_width = sizeof(uint32_t);
+
+	maxw = sizeof(uint64_t);
+	for(unsigned k=0; k<m_traces.size(); k++) {
+		const TRACEINFO	*info = &m_traces[k];
+		SCOPECOL_COLUMN	*col  = &cols[k+2];
+
+		strncpy(col->m_name, info->m_name, SCOPECOL_NAMELEN-1);
+		col->m_nbits  = info->m_nbits;
+		col->m_nshift = info->m_nshift;
+		col->m_width  = (info->m_nbits <= 8) ? 1
+				: (info->m_nbits <= 16) ? 2 : 4;
+		if (sign_extend && info->m_nbits > 1)
+			col->m_flags = SCOPECOL_SIGNED;
+	}
+
+	offset = align_up(sizeof(hdr) + ncols * sizeof(SCOPECOL_COLUMN));
+	for(unsigned k=0; k<ncols; k++) {
+		cols[k].m_offset = offset;
+		offset += align_up((size_t)nrows * cols[k].m_width);
+	}
+	// }}}
+
+	// Write everything out
+	// {{{
+	offset = sizeof(hdr);
+	ok = ok && (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+	ok = ok && write_padded(fp, cols, ncols * sizeof(SCOPECOL_COLUMN),
+								offset);
+	ok = ok && write_padded(fp, tcol, (size_t)nrows * sizeof(uint64_t),
+								offset);
+	ok = ok && write_padded(fp, rows, (size_t)nrows * sizeof(uint32_t),
+								offset);
+
+	cbuf = new char[(size_t)nrows * maxw];
+	for(unsigned k=2; ok && k<ncols; k++) {
+		const SCOPECOL_COLUMN	*col = &cols[k];
+		bool	sx = (col->m_flags & SCOPECOL_SIGNED) != 0;
+
+		switch(col->m_width) {
+		case 1: unpack_column((uint8_t *)cbuf, rows, nrows,
+				col->m_nshift, col->m_nbits, sx);
+			break;
+		case 2: unpack_column((uint16_t *)cbuf, rows, nrows,
+				col->m_nshift, col->m_nbits, sx);
+			break;
+		default: unpack_column((uint32_t *)cbuf, rows, nrows,
+				col->m_nshift, col->m_nbits, sx);
+			break;
+		}
+
+		ok = write_padded(fp, cbuf, (size_t)nrows * col->m_width,
+								offset);
+	}
+	// }}}
+
+	delete[] cbuf;
+	delete[] cols;
+	delete[] tcol;
+	delete[] rows;
+
+	if (!ok)
+		fprintf(stderr, "ERR: Failed to write columnar trace data\n");
+	return ok;
+} // }}}
+
+/*
+ * writecolumns
+ * {{{
+ * Main user entry point for columnar export.  Like writevcd() above, this just
+ * opens the named file and writes to it.
+ */
+bool	SCOPE::writecolumns(const char *fname, bool sign_extend) {
+	FILE	*fp = fopen(fname, "wb");
+	bool	ok;
+
+	if (fp == NULL) {
+		fprintf(stderr, "ERR: Cannot open %s for writing!\n", fname);
+		fprintf(stderr, "ERR: Column file not written\n");
+		return false;
+	}
+
+	ok = writecolumns(fp, sign_extend);
+
+	fclose(fp);
+	return ok;
+} // }}}
@@ -44,7 +44,9 @@
 #ifndef	SCOPECLS_H
 #define	SCOPECLS_H
 
+#include <stdint.h>
 #include <vector>
+#include <thread>
 #include "devbus.h"
 
 
@@ -68,6 +70,54 @@ public:
 	unsigned	m_nbits, m_nshift;
 }; // }}}
 
+/*
+ * SCOPECOL_HEADER, SCOPECOL_COLUMN
+ * {{{
+ * These two structures define the columnar (binary) trace format written by
+ * SCOPE::writecolumns().  The file starts with one SCOPECOL_HEADER, followed
+ * by m_ncols SCOPECOL_COLUMN descriptors.  Each column then follows as a
+ * packed array of m_nrows elements, each m_width bytes wide, starting at
+ * m_offset bytes from the beginning of the file.  Column data always begins
+ * on a SCOPECOL_ALIGN byte boundary, so the whole file may be mmap()'d and
+ * each column used in place as a typed array.
+ *
+ * All values are written in host byte order.
+ *
+ * The first two columns are always _time, the (uint64_t) clock index of each
+ * row, and _raw, the (uint32_t) raw scope data word.  Every registered trace
+ * then follows, in registration order, using the smallest of a 1, 2, or 4
+ * byte integer that will hold m_nbits.
+ */
+#define	SCOPECOL_MAGIC		"SCOPECOL"
+#define	SCOPECOL_VERSION	1
+#define	SCOPECOL_ALIGN		64
+#define	SCOPECOL_NAMELEN	48
+
+// Header flags
+#define	SCOPECOL_COMPRESSED	1	// Data came from a compressed scope
+// Column flags
+#define	SCOPECOL_SIGNED		1	// Column has been sign extended
+
+typedef	struct {
+	char		m_magic[8];	// SCOPECOL_MAGIC, not NUL terminated
+	uint32_t	m_version,	// SCOPECOL_VERSION
+			m_hdrlen,	// sizeof(SCOPECOL_HEADER)
+			m_ncols,	// Number of SCOPECOL_COLUMN's to follow
+			m_nrows,	// Number of elements in every column
+			m_clkfreq_hz,	// Scope clock rate
+			m_flags;	// SCOPECOL_COMPRESSED
+	uint64_t	m_trigger;	// _time value of the trigger
+} SCOPECOL_HEADER;
+
+typedef	struct {
+	char		m_name[SCOPECOL_NAMELEN]; // NUL terminated trace name
+	uint32_t	m_nbits, m_nshift,	// As in TRACEINFO
+			m_width,	// Bytes per element: 1, 2, 4, or 8
+			m_flags;	// SCOPECOL_SIGNED
+	uint64_t	m_offset;	// File offset to the column's data
+} SCOPECOL_COLUMN;
+// }}}
+
 /*
  * SCOPE
  * {{{
@@ -87,12 +137,27 @@ class	SCOPE {
 			m_vector_read;
 	unsigned	m_scoplen,	// Number of words in the scopes memory
 			m_holdoff;	// The bias, or samples since trigger
+			// Vector reads are broken into chunks of m_chunklen
+			// words, each verified against the control register
+			// once read, and retried up to m_maxretries times
+	unsigned	m_chunklen, m_maxretries;
+			// Number of threads to use when formatting output
+	unsigned	m_nthreads;
 	unsigned	*m_data;	// Data read from the scope
 	unsigned	m_clkfreq_hz;
 
+	// Capture buffers, each m_scoplen words long, not currently in use.
+	// Buffers are taken from here by rawread(), and returned by release()
+	// so that repeated captures don't need to allocate anything.
+	std::vector<DEVBUS::BUSW *> m_pool;
+
 	// The m_traces variable holds a list of all of the various wire
 	// definitions within the scope data word.
-	std::vector<TRACEINFO *> m_traces;
+	std::vector<TRACEINFO>	m_traces;
+
+	// Get a capture buffer from the pool, allocating one only if the
+	// pool is empty
+	DEVBUS::BUSW	*getbuffer(void);
 
 public:
 	SCOPE(DEVBUS *fpga, unsigned addr,
@@ -111,15 +176,22 @@ public:
 
 		// Default clock frequency: 100MHz.
 		m_clkfreq_hz = 100000000;
+
+		m_chunklen   = 256;
+		m_maxretries = 4;
+
+		m_nthreads = std::thread::hardware_concurrency();
+		if (m_nthreads < 1)
+			m_nthreads = 1;
 	} // }}}
 
 	// Free up any of our allocated memory.
 	~SCOPE(void) {
 		// {{{
-		for(unsigned i=0; i<m_traces.size(); i++)
-			delete m_traces[i];
-		if (m_data) delete[] m_data;
-	} }}}
+		release();
+		for(unsigned i=0; i<m_pool.size(); i++)
+			delete[] m_pool[i];
+	} // }}}
 
 	// ready()
 	// {{{
@@ -153,11 +225,83 @@ public:
 	// Read any previously set clock speed.
 	unsigned get_clkfreq_hz(void) { return m_clkfreq_hz; }
 
+	// Capture lifecycle: arm(), capture(), and release()
+	// {{{
+	// A long running program may capture from the scope over and over
+	// again, by calling arm() to start a capture, capture() until it
+	// returns true, and then release() once it is done with the data.
+	// Capture buffers are kept in a pool and reused from one capture to
+	// the next, so once the pool has been filled (see preallocate()) this
+	// cycle allocates no memory at all.
+	//
+	// arm()
+	//	Reset the scope, keeping its current holdoff, so that it will
+	//	make a new capture.  Any data previously read from the scope is
+	//	released.
+	void	arm(void);
+	//
+	// capture()
+	//	If the scope has stopped, read its data into a capture buffer
+	//	and return true.  Otherwise return false.  The data may then be
+	//	used via print(), writevcd(), writecolumns(), or operator[].
+	bool	capture(void);
+	//
+	// release()
+	//	Return the current capture buffer to the pool.
+	void	release(void);
+	//
+	// preallocate(nbuffers)
+	//	Make certain at least nbuffers capture buffers are waiting
+	//	in the pool.
+	void	preallocate(unsigned nbuffers);
+	// }}}
+
+	// Accessors, used by anything (such as a SCOPEGROUP) needing to walk
+	// through the scope's data and trace definitions from the outside.
+	// {{{
+	unsigned	get_holdoff(void) { scoplen(); return m_holdoff; }
+	bool		compressed(void) const { return m_compressed; }
+	unsigned	ntraces(void) const { return m_traces.size(); }
+	const TRACEINFO	*gettrace(unsigned k) const { return &m_traces[k]; }
+	// }}}
+
+	// set_chunk
+	// {{{
+	// Adjust how vector reads are broken up.  Each chunk of chunklen words
+	// is read with a single readz(), and then checked against the scope's
+	// control register.  A chunk that fails that check is re-read, up to
+	// retries times, before we give up.
+	void	set_chunk(unsigned chunklen, unsigned retries = 4) {
+		m_chunklen   = (chunklen > 0) ? chunklen : 1;
+		m_maxretries = retries;
+	}
+	// }}}
+
 	// rawready
 	// {{{
 	// Read the data from the scope and place it into our m_data array.
-	// Nothing more is done with it beyond that.
-	virtual	void	rawread(void);
+	// Nothing more is done with it beyond that.  Returns false, with
+	// m_data left NULL, if the scope couldn't be read.
+	virtual	bool	rawread(void);
+	// }}}
+
+	// rewind
+	// {{{
+	// Return the scope's read pointer to the beginning of its buffer,
+	// without otherwise disturbing the capture.  Returns true if the
+	// scope then reports its read pointer as being at zero.
+	bool	rewind(void);
+	// }}}
+
+	// readchunk
+	// {{{
+	// Read len words into buf, starting with the scope's read pointer at
+	// word pos, and then verify the read by checking the control register.
+	// The control register must not have changed from ctl, save for its
+	// ZERO bit, which must be set only if the read pointer has wrapped
+	// back to the beginning of the buffer.  Returns true on success.
+	bool	readchunk(unsigned pos, unsigned len, DEVBUS::BUSW *buf,
+			DEVBUS::BUSW ctl);
 	// }}}
 
 	// print()
@@ -170,6 +314,41 @@ public:
 	void	print(void);
 	// }}}
 
+	// set_threads
+	// {{{
+	// Set the number of threads used by print() and writevcd() to format
+	// their output.  The default is one thread per available CPU.  Set to
+	// one to format everything on the calling thread.
+	void	set_threads(unsigned nthreads) {
+		m_nthreads = (nthreads > 0) ? nthreads : 1;
+	}
+	// }}}
+
+	// print_chunk, vcd_chunk, and format_chunks
+	// {{{
+	// print() and writevcd() format their output in independent chunks of
+	// the data buffer, from word start up to (but not including) word end.
+	// addrv is the (compressed) address of the first word of the chunk,
+	// offset the address of the trigger, and alen the full address length
+	// as returned from getaddresslen().
+	//
+	// format_chunks() then hands these chunks out to a set of threads,
+	// each formatting into its own memory buffer, and writes the buffers
+	// to fp in order.  count_first_run selects whether a leading run
+	// length word (in compressed scopes) counts towards the address or
+	// not--print() and writevcd() have always disagreed on this point.
+	typedef	void	(SCOPE::*CHUNKFN)(FILE *fp, unsigned start,
+				unsigned end, unsigned long addrv, long offset,
+				unsigned long alen);
+	void	print_chunk(FILE *fp, unsigned start, unsigned end,
+			unsigned long addrv, long offset, unsigned long alen);
+	void	vcd_chunk(FILE *fp, unsigned start, unsigned end,
+			unsigned long addrv, long offset, unsigned long alen);
+	void	format_chunks(FILE *fp, CHUNKFN fn, long offset,
+			unsigned long alen, bool count_first_run,
+			bool parallel);
+	// }}}
+
 	// decode()
 	// {{{
 	// decode() works together with print() above.  The print() routine
@@ -181,6 +360,15 @@ public:
 	// a "\n" and continues.  Hence ... the purpose of the decode()
 	// function--and why it needs to be scope specific.
 	virtual	void	decode(DEVBUS::BUSW v) const = 0;
+
+	// This second form of decode() writes to the given FILE * rather than
+	// to the standard output.  Scopes that override it, returning true,
+	// allow print() to decode their data on multiple threads at once.
+	// Those that don't will be printed one word at a time via decode()
+	// above.
+	virtual	bool	decode(FILE *fp, DEVBUS::BUSW v) const {
+		return false;
+	}
 	// }}}
 
 	//
@@ -215,7 +403,8 @@ public:
 	//
 	// This is also an internal call that you are not likely to need to
 	// modify.
-	void	write_binary_trace(FILE *fp, TRACEINFO *info, unsigned value);
+	void	write_binary_trace(FILE *fp, const TRACEINFO *info,
+			unsigned value);
 	// }}}
 
 	// writevcd()
@@ -238,6 +427,20 @@ public:
 	unsigned	getaddresslen(void);
 	// }}}
 
+	// writecolumns()
+	// {{{
+	// Write the scope's data to a file in the columnar SCOPECOL format
+	// described above, splitting each data word into one typed array per
+	// registered trace.  If sign_extend is true, every multi-bit trace is
+	// sign extended into its column rather than zero extended.  Returns
+	// true on success, false (with a message to stderr) otherwise.
+	bool	writecolumns(const char *fname, bool sign_extend = false);
+	// This is an alternate entry point, useful if you already have a
+	// FILE *.  This will write the data to the file, but not close the
+	// file.  The file is assumed to be positioned at offset zero.
+	bool	writecolumns(FILE *fp, bool sign_extend = false);
+	// }}}
+
 	// define_traces
 	// {{{
 	// Your program needs to define a define_traces() function, which will
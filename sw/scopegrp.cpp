@@ -0,0 +1,296 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	scopegrp.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Arm, read, and write several scopes together, aligning their
+//		captures by their trigger locations and clock rates.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+
+#include "devbus.h"
+#include "scopecls.h"
+#include "scopegrp.h"
+
+// One value change (or set of value changes) within the merged VCD file
+typedef	struct {
+	long		m_when_ps;
+	unsigned	m_scope, m_idx;
+	bool		m_clock_low;	// Negative clock edge only
+} SGEVENT;
+
+static	bool	sgevent_before(const SGEVENT &a, const SGEVENT &b) {
+	return a.m_when_ps < b.m_when_ps;
+}
+
+void	SCOPEGROUP::add(SCOPE *scope, const char *name) {
+	m_scopes.push_back(scope);
+	m_names.push_back(name);
+}
+
+void	SCOPEGROUP::arm(void) {
+	for(unsigned k=0; k<m_scopes.size(); k++)
+		m_scopes[k]->arm();
+}
+
+bool	SCOPEGROUP::ready(void) {
+	// {{{
+	bool	all_ready = true;
+
+	// Check every scope, even after we know we aren't ready, so that
+	// every scope has a chance to learn its length and holdoff.
+	for(unsigned k=0; k<m_scopes.size(); k++)
+		if (!m_scopes[k]->ready())
+			all_ready = false;
+	return all_ready;
+} // }}}
+
+bool	SCOPEGROUP::capture(void) {
+	// {{{
+	// The debugging bus only supports one outstanding request at a time,
+	// so there's no advantage to interleaving reads from one scope with
+	// those of another.  Instead, we read each scope in its turn, back to
+	// back, using each scope's (chunked and verified) vector reads.
+	for(unsigned k=0; k<m_scopes.size(); k++) {
+		if (!m_scopes[k]->rawread()) {
+			fprintf(stderr, "ERR: Could not read the %s scope\n",
+				m_names[k]);
+			return false;
+		}
+		if (m_scopes[k]->ntraces() == 0)
+			m_scopes[k]->define_traces();
+	}
+
+	return true;
+} // }}}
+
+long	SCOPEGROUP::trigger_clk(unsigned k) {
+	// {{{
+	SCOPE	*s = m_scopes[k];
+
+	// If the holdoff is zero, the triggered item is the very last one.
+	return (long)s->getaddresslen() - (long)s->get_holdoff() - 1;
+} // }}}
+
+long	SCOPEGROUP::when_ps(unsigned k, long clk, long trigger_ps) {
+	// {{{
+	double	dt = (double)(clk - trigger_clk(k))
+			/ (double)m_scopes[k]->get_clkfreq_hz();
+
+	return trigger_ps + (long)(dt * 1e12 + ((dt < 0) ? -0.5 : 0.5));
+} // }}}
+
+void	SCOPEGROUP::write_header(FILE *fp, long trigger_ps) {
+	// {{{
+	time_t	now;
+
+	time(&now);
+	fprintf(fp, "$version Generated by WBScope $end\n");
+	fprintf(fp, "$date %s\n $end\n", ctime(&now));
+	fprintf(fp, "$timescale 1ps $end\n\n");
+	fprintf(fp, "$timezero %ld $end\n\n", -trigger_ps);
+
+	for(unsigned k=0; k<m_scopes.size(); k++) {
+		SCOPE	*s = m_scopes[k];
+		char	g = 'a' + k;
+
+		fprintf(fp, " $scope module %s $end\n", m_names[k]);
+		if (s->compressed()) {
+			fprintf(fp, "  $var wire %2d \'R%c _raw_data [%d:0] $end\n",
+				31, g, 30);
+		} else {
+			fprintf(fp, "  $var wire %2d \'C%c clk $end\n", 1, g);
+			fprintf(fp, "  $var wire %2d \'R%c _raw_data [%d:0] $end\n",
+				32, g, 31);
+		}
+		fprintf(fp, "  $var wire %2d \'T%c _trigger $end\n", 1, g);
+
+		for(unsigned t=0; t<s->ntraces(); t++) {
+			const TRACEINFO *info = s->gettrace(t);
+
+			fprintf(fp, "  $var wire %2d %s%c %s", info->m_nbits,
+				info->m_key, g, info->m_name);
+			if ((info->m_nbits != 1)
+					&&(NULL != strchr(info->m_name, '[')))
+				fprintf(fp, "[%d:0] $end\n", info->m_nbits-1);
+			else
+				fprintf(fp, " $end\n");
+		}
+		fprintf(fp, " $upscope $end\n");
+	}
+
+	fprintf(fp, "$enddefinitions $end\n");
+} // }}}
+
+void	SCOPEGROUP::writevcd(FILE *fp) {
+	// {{{
+	std::vector<SGEVENT>	events;
+	long	trigger_ps = 0, last_ps = -1;
+	char	key[8];
+
+	// Rather than write an all zero trace for any scope we couldn't read,
+	// write nothing at all
+	if (!capture()) {
+		fprintf(stderr, "ERR: Trace file not written\n");
+		return;
+	}
+
+	// The trigger lands at the same time in every scope.  Place it late
+	// enough in the file that no scope's data starts before time zero.
+	// {{{
+	for(unsigned k=0; k<m_scopes.size(); k++) {
+		long	tps;
+
+		// Round as when_ps() does, so that no scope's first sample
+		// ever lands before time zero
+		tps = (long)((double)trigger_clk(k) * 1e12
+				/ (double)m_scopes[k]->get_clkfreq_hz() + 0.5);
+		if (tps > trigger_ps)
+			trigger_ps = tps;
+	}
+	// }}}
+
+	// Build one list of value changes across every scope, sorted by time
+	// {{{
+	for(unsigned k=0; k<m_scopes.size(); k++) {
+		SCOPE	*s = m_scopes[k];
+		unsigned n = s->scoplen();
+		SGEVENT	ev;
+
+		ev.m_scope = k;
+		if (s->compressed()) {
+			long	addrv = 0;
+
+			ev.m_clock_low = false;
+			for(unsigned i=0; i<n; i++) {
+				unsigned v = (*s)[i];
+
+				if ((v>>31)&1) {
+					if (i != 0)
+						addrv += (v & 0x7fffffff) + 1;
+					continue;
+				}
+
+				ev.m_idx     = i;
+				ev.m_when_ps = when_ps(k, addrv++, trigger_ps);
+				events.push_back(ev);
+			}
+		} else {
+			long	half_ps = (long)(0.5e12
+					/ (double)s->get_clkfreq_hz() + 0.5);
+
+			for(unsigned i=0; i<n; i++) {
+				ev.m_idx       = i;
+				ev.m_when_ps   = when_ps(k, i, trigger_ps);
+				ev.m_clock_low = false;
+				events.push_back(ev);
+
+				ev.m_when_ps  += half_ps;
+				ev.m_clock_low = true;
+				events.push_back(ev);
+			}
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(), sgevent_before);
+	// }}}
+
+	write_header(fp, trigger_ps);
+
+	// Now walk through the events, writing each to the file
+	// {{{
+	for(unsigned e=0; e<events.size(); e++) {
+		const SGEVENT	&ev = events[e];
+		SCOPE		*s = m_scopes[ev.m_scope];
+		char		g = 'a' + ev.m_scope;
+		unsigned	v = (*s)[ev.m_idx];
+
+		if (ev.m_when_ps != last_ps) {
+			fprintf(fp, "#%ld\n", ev.m_when_ps);
+			last_ps = ev.m_when_ps;
+		}
+
+		if (ev.m_clock_low) {
+			fprintf(fp, "0\'C%c\n", g);
+			continue;
+		}
+
+		if (!s->compressed())
+			fprintf(fp, "1\'C%c\n", g);
+
+		sprintf(key, "\'R%c", g);
+		s->write_binary_trace(fp, (s->compressed()) ? 31:32, v, key);
+
+		fprintf(fp, "%d\'T%c\n", (ev.m_when_ps == trigger_ps) ? 1:0, g);
+
+		for(unsigned t=0; t<s->ntraces(); t++) {
+			const TRACEINFO *info = s->gettrace(t);
+
+			sprintf(key, "%s%c", info->m_key, g);
+			s->write_binary_trace(fp, info->m_nbits,
+					v >> info->m_nshift, key);
+		}
+	}
+	// }}}
+} // }}}
+
+/*
+ * writevcd
+ * {{{
+ * Open the named file, and write the merged VCD data into it.
+ */
+void	SCOPEGROUP::writevcd(const char *trace_file_name) {
+	FILE	*fp;
+
+	// Read the scopes before creating the file, so that a failed read
+	// doesn't leave an empty file behind
+	if (!capture()) {
+		fprintf(stderr, "ERR: Trace file not written\n");
+		return;
+	}
+
+	fp = fopen(trace_file_name, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "ERR: Cannot open %s for writing!\n", trace_file_name);
+		fprintf(stderr, "ERR: Trace file not written\n");
+		return;
+	}
+
+	writevcd(fp);
+
+	fclose(fp);
+} // }}}
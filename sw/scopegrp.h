@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	scopegrp.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	A SCOPEGROUP collects several SCOPEs together, so that they
+//		may be armed together, read back together, and then written
+//	into a single VCD file with their captures aligned in time.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	SCOPEGRP_H
+#define	SCOPEGRP_H
+
+#include <stdio.h>
+#include <vector>
+#include "scopecls.h"
+
+/*
+ * SCOPEGROUP
+ * {{{
+ * Scopes within a group are assumed to share a common trigger--that is, their
+ * triggers are assumed to all refer to the same moment in time.  Each scope
+ * may run from its own clock, as given by its get_clkfreq_hz(), and may have
+ * its own holdoff.  When written to a VCD file, every scope's trigger lands
+ * on the same time, and every scope gets its own module scope within the file,
+ * named after the name it was given when it was added to the group.
+ *
+ * The group does not own the scopes within it.  They must be freed by the
+ * caller, after the group is done with them.
+ */
+class	SCOPEGROUP {
+	std::vector<SCOPE *>		m_scopes;
+	std::vector<const char *>	m_names;
+
+	// Time, in picoseconds from the beginning of the file, of clock
+	// number clk within scope k
+	long	when_ps(unsigned k, long clk, long trigger_ps);
+
+	// Clock number of the trigger within scope k
+	long	trigger_clk(unsigned k);
+
+	void	write_header(FILE *fp, long trigger_ps);
+public:
+	SCOPEGROUP(void) {}
+	~SCOPEGROUP(void) {}
+
+	// add()
+	// {{{
+	// Add a scope to the group, under the given (VCD module) name.
+	void	add(SCOPE *scope, const char *name);
+	// }}}
+
+	unsigned	size(void) const { return m_scopes.size(); }
+	SCOPE	*operator[](unsigned k) { return m_scopes[k]; }
+
+	// arm()
+	// {{{
+	// Reset every scope within the group, so that each makes a new
+	// capture.
+	void	arm(void);
+	// }}}
+
+	// ready()
+	// {{{
+	// Returns true once every scope within the group has stopped.
+	bool	ready(void);
+	// }}}
+
+	// capture()
+	// {{{
+	// Read every scope within the group.  This doesn't check ready(),
+	// so make certain all the scopes have stopped first.  Returns false
+	// if any scope couldn't be read.
+	bool	capture(void);
+	// }}}
+
+	// writevcd()
+	// {{{
+	// Write all of the scopes within the group into one VCD file.  As
+	// with SCOPE::writevcd(), either a file name or an open FILE * may
+	// be given.  Nothing is written if any scope can't be read.
+	void	writevcd(const char *trace_file_name);
+	void	writevcd(FILE *fp);
+	// }}}
+}; // }}}
+
+#endif	// SCOPEGRP_H
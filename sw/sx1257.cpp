@@ -0,0 +1,301 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	sx1257.cpp
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	Implements the SX1257 register shadow.  See sx1257.h for
+//		details.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "sx1257.h"
+
+// Unchanged registers, between two that have changed, are rewritten (with
+// their current values) if there are no more than this many of them.  Each
+// SPI write costs three bytes of overhead on the I2C bus, besides its data.
+#define	MERGE_GAP	2
+// The longest SPI transfer we'll make, limited by our message buffers
+#define	MAX_BURST	29
+
+const RFNAME rfregs[RFREGS] = {
+	RF_REGMODE,         1, "RegMode",
+	RF_REGFRFRXMSB,     3, "FRFRX",
+	RF_REGFRFTXMSB,     3, "FRFTx",
+	RF_REGTXGAIN,       1, "TxGain",
+	RF_REGTXBW,         1, "TxBandwidth",
+	RF_REGTXBW,         1, "TxBW",
+	RF_REGTXDACBW,      1, "TxDACBandwidth",
+	RF_REGRXANAGAIN,    1, "RxAnalogGain",
+	RF_REGRXBW,         1, "RxBandwidth",
+	RF_REGRXBW,         1, "RxBW",
+	RF_REGRXPLLBW,      1, "RxPLLBW",
+	RF_REGDIOMAPPING,   1, "DioMapping",
+	RF_REGCLKSELECT,    1, "ClkSelect",
+	RF_REGMODESTATUS,   1, "ModeStatus",
+	RF_REGLOWBATTHRESH, 1, "LowBatThresh"
+};
+
+unsigned	rfaddrdecode(const char *v) {
+	if (isalpha(v[0])) {
+		for(int i=0; i<RFREGS; i++)
+			if (strcasecmp(v, rfregs[i].rf_name)==0)
+				return rfregs[i].rf_addr;
+		fprintf(stderr, "Unknown register: %s\n", v);
+		exit(-2);
+	} else
+		return strtoul(v, NULL, 0);
+}
+
+const char *rfaddrname(const unsigned v) {
+	for(int i=0; i<RFREGS; i++)
+		if (rfregs[i].rf_addr == v)
+			return rfregs[i].rf_name;
+	return NULL;
+}
+
+unsigned	rfaddrbytes(const unsigned v) {
+	for(int i=0; i<RFREGS; i++)
+		if (rfregs[i].rf_addr == v)
+			return rfregs[i].rf_bytes;
+	return 1;
+}
+
+// writable
+// {{{
+// True for those registers that may be rewritten as part of a merged burst:
+// every register in the name table, save the read-only mode status
+static	bool	writable(unsigned addr) {
+	if (addr == RF_REGMODESTATUS)
+		return false;
+	for(int i=0; i<RFREGS; i++)
+		if (addr >= rfregs[i].rf_addr
+				&& addr < rfregs[i].rf_addr + rfregs[i].rf_bytes)
+			return true;
+	return false;
+}
+// }}}
+
+SX1257::SX1257(I2CBUS *i2c) : m_i2c(i2c), m_nwritten(0), m_nwrites(0) {
+	memset(m_shadow, 0, sizeof(m_shadow));
+	memset(m_target, 0, sizeof(m_target));
+	memset(m_staged, 0, sizeof(m_staged));
+	invalidate();
+}
+
+void	SX1257::invalidate(void) {
+	memset(m_known, 0, sizeof(m_known));
+}
+
+int	SX1257::spi_read(unsigned addr, unsigned count, unsigned char *buf) {
+	// {{{
+	char	msg[32];
+	int	msglen = 0;
+
+	if (count > MAX_BURST)
+		count = MAX_BURST;
+	msg[msglen++] = RF_SPI_WRITE;
+	msg[msglen++] = addr & 0x07f; // Leave the top bit clear for a read
+	for(unsigned k=0; k<count; k++)
+		msg[msglen++] = 0;
+	if (m_i2c->write(RF_I2C_WRITE, msglen, msg))
+		return 1;
+
+	// Read back the byte shifted in alongside the address, followed by
+	// the register(s)
+	memset(msg, 0, sizeof(msg));
+	if (m_i2c->read(RF_I2C_READ, msglen-1, msg))
+		return 1;
+
+	for(unsigned k=0; k<count; k++)
+		buf[k] = msg[1+k];
+	return 0;
+}
+// }}}
+
+int	SX1257::spi_write(unsigned addr, unsigned count,
+		const unsigned char *buf) {
+	// {{{
+	char	msg[32];
+	int	msglen = 0;
+
+	msg[msglen++] = RF_SPI_WRITE;
+	msg[msglen++] = addr | 0x80; // Set the top bit for a write
+	for(unsigned k=0; k<count && k < MAX_BURST; k++)
+		msg[msglen++] = buf[k];
+
+	m_nwritten += msglen-2;
+	m_nwrites++;
+	return m_i2c->write(RF_I2C_WRITE, msglen, msg);
+}
+// }}}
+
+int	SX1257::load(void) {
+	// {{{
+	if (spi_read(0, SX1257_NREGS, m_shadow))
+		return 1;
+	for(int k=0; k<SX1257_NREGS; k++)
+		m_known[k] = true;
+	return 0;
+}
+// }}}
+
+unsigned	SX1257::fetch(unsigned addr, unsigned count) {
+	// {{{
+	unsigned char	buf[MAX_BURST];
+	unsigned	result = 0;
+
+	if (count == 0)
+		count = rfaddrbytes(addr);
+	if (count > 4)
+		count = 4;
+
+	if (spi_read(addr, count, buf))
+		return 0;
+	for(unsigned k=0; k<count; k++) {
+		result = (result << 8) | buf[k];
+		if (addr+k < SX1257_NREGS) {
+			m_shadow[addr+k] = buf[k];
+			m_known[addr+k]  = true;
+		}
+	}
+
+	return result;
+}
+// }}}
+
+unsigned	SX1257::get(unsigned addr, unsigned count) const {
+	// {{{
+	unsigned	result = 0;
+
+	if (count == 0)
+		count = rfaddrbytes(addr);
+	for(unsigned k=0; k<count && k<4; k++)
+		result = (result << 8)
+			| ((addr+k < SX1257_NREGS) ? m_shadow[addr+k] : 0);
+	return result;
+}
+// }}}
+
+void	SX1257::set(unsigned addr, unsigned value, unsigned count) {
+	// {{{
+	if (count == 0)
+		count = rfaddrbytes(addr);
+	for(unsigned k=0; k<count && k<4; k++) {
+		unsigned	a = addr + k;
+
+		if (a >= SX1257_NREGS)
+			continue;
+		m_target[a] = (value >> ((count-1-k)*8)) & 0x0ff;
+		m_staged[a] = true;
+	}
+}
+// }}}
+
+void	SX1257::set_rx_freq(double hz) {
+	set(RF_REGFRFRXMSB, (unsigned)round(hz / SX1257_FSTEP), 3);
+}
+
+void	SX1257::set_tx_freq(double hz) {
+	set(RF_REGFRFTXMSB, (unsigned)round(hz / SX1257_FSTEP), 3);
+}
+
+int	SX1257::commit(void) {
+	// {{{
+	int	err = 0;
+
+	// A register needs writing if it's been staged, and either we don't
+	// know what the radio holds, or the radio holds something else
+	bool	dirty[SX1257_NREGS];
+	for(int k=0; k<SX1257_NREGS; k++)
+		dirty[k] = m_staged[k] && (!m_known[k]
+				|| m_target[k] != m_shadow[k]);
+
+	// The radio only acts on a multi-byte register, such as FRFRX, once
+	// its last (LSB) byte is written.  If any byte of one is dirty, write
+	// all of its bytes, MSB first, so the new value is applied as a whole.
+	for(int i=0; i<RFREGS; i++) {
+		unsigned	a = rfregs[i].rf_addr, n = rfregs[i].rf_bytes;
+		bool		any = false;
+
+		if (n < 2 || a + n > SX1257_NREGS)
+			continue;
+		for(unsigned j=a; j<a+n; j++)
+			any = any || dirty[j];
+		if (any) for(unsigned j=a; j<a+n; j++)
+			dirty[j] = m_staged[j] || m_known[j];
+	}
+
+	for(int k=0; k<SX1257_NREGS; ) {
+		unsigned char	buf[MAX_BURST];
+		int		last;
+
+		if (!dirty[k]) {
+			k++;
+			continue;
+		}
+
+		// Extend the burst across any short gap of known, writable
+		// registers, so long as another dirty register follows
+		last = k;
+		for(int j=k+1; j<SX1257_NREGS && j <= last+1+MERGE_GAP
+				&& j-k < MAX_BURST; j++) {
+			if (dirty[j])
+				last = j;
+			else if (!m_known[j] || !writable(j))
+				break;
+		}
+
+		for(int j=k; j<=last; j++)
+			buf[j-k] = (m_staged[j]) ? m_target[j] : m_shadow[j];
+		if (spi_write(k, last+1-k, buf)) {
+			// We no longer know what the radio holds
+			for(int j=k; j<=last; j++)
+				m_known[j] = false;
+			err = 1;
+		} else for(int j=k; j<=last; j++) {
+			m_shadow[j] = buf[j-k];
+			m_known[j]  = true;
+		}
+
+		k = last+1;
+	}
+
+	memset(m_staged, 0, sizeof(m_staged));
+	return err;
+}
+// }}}
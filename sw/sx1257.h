@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Filename: 	sx1257.h
+// {{{
+// Project:	SDR, a basic Soft(Gate)ware Defined Radio architecture
+//
+// Purpose:	A host side model of the SX1257 radio, reached via the SPI
+//		bridge on the radio's I2C bus.
+//
+//	The SX1257 object keeps a shadow copy of the radio's registers.  The
+//	whole register set can be loaded with one burst read, after which
+//	register reads come from the shadow.  Writes are staged, and then
+//	committed together: only the registers that differ from the shadow
+//	are written, with runs of neighbouring registers merged into a single
+//	burst.  Multi-byte registers are written whole, since the radio only
+//	applies them on their LSB write.  Retuning the receiver thus costs the
+//	three bytes of FRFRX, rather than a full reconfiguration.
+//
+//	Registers whose value isn't yet known (i.e. before any load) are
+//	always written when staged.
+//
+//
+// Creator:	Dan Gisselquist, Ph.D.
+//		Gisselquist Technology, LLC
+//
+////////////////////////////////////////////////////////////////////////////////
+// }}}
+// Copyright (C) 2019-2024, Gisselquist Technology, LLC
+// {{{
+// This program is free software (firmware): you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or (at
+// your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTIBILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program.  (It's in the $(ROOT)/doc directory.  Run make with no
+// target there if the PDF file isn't present.)  If not, see
+// <http://www.gnu.org/licenses/> for a copy.
+// }}}
+// License:	GPL, v3, as defined and found on www.gnu.org,
+// {{{
+//		http://www.gnu.org/licenses/gpl.html
+//
+////////////////////////////////////////////////////////////////////////////////
+//
+#ifndef	SX1257_H
+#define	SX1257_H
+
+#include <stdint.h>
+#include "i2cbus.h"
+
+// The SPI bridge, on the I2C bus
+// {{{
+#define	SLAVE_ADDRESS	0x50
+#define	MASTER_WR	0
+#define	MASTER_RD	1
+#define	RF_I2C_WRITE	SLAVE_ADDRESS | MASTER_WR
+#define	RF_I2C_READ	SLAVE_ADDRESS | MASTER_RD
+
+#define	RF_SPI_WRITE		0x01
+// }}}
+
+// SX1257 registers
+// {{{
+#define	RF_REGMODE		0x00
+#define	RF_REGFRFRXMSB		0x01
+#define	RF_REGFRFRXMIB		0x02
+#define	RF_REGFRFRXLSB		0x03
+#define	RF_REGFRFTXMSB		0x04
+#define	RF_REGFRFTXMIB		0x05
+#define	RF_REGFRFTXLSB		0x06
+#define	RF_REGVERSION		0x07
+#define	RF_REGTXGAIN		0x08
+#define	RF_REGTXBW		0x0a
+#define	RF_REGTXDACBW		0x0b
+#define	RF_REGRXANAGAIN		0x0c
+#define	RF_REGRXBW		0x0d
+#define	RF_REGRXPLLBW		0x0e
+#define	RF_REGDIOMAPPING	0x0f
+#define	RF_REGCLKSELECT		0x10
+#define	RF_REGMODESTATUS	0x11
+#define	RF_REGLOWBATTHRESH	0x1a
+
+// Registers 0x00 through RF_REGLOWBATTHRESH
+#define	SX1257_NREGS		0x1b
+
+// The frequency step of the FRF registers, given the 36MHz reference
+#define	SX1257_FSTEP		(36e6 / (1<<19))
+// }}}
+
+// The register name table
+// {{{
+typedef	struct	{
+	unsigned	rf_addr, rf_bytes;
+	const char	*rf_name;
+} RFNAME;
+
+#define	RFREGS	15
+extern	const RFNAME	rfregs[RFREGS];
+
+// Decode a register name (or number), returning its address.  Exits on an
+// unknown name.
+extern	unsigned	rfaddrdecode(const char *v);
+// The name of the register at the given address, or NULL
+extern	const char	*rfaddrname(const unsigned v);
+// The number of bytes in the register at the given address
+extern	unsigned	rfaddrbytes(const unsigned v);
+// }}}
+
+class	SX1257 {
+	I2CBUS		*m_i2c;
+	unsigned char	m_shadow[SX1257_NREGS], m_target[SX1257_NREGS];
+	bool		m_known[SX1257_NREGS], m_staged[SX1257_NREGS];
+	unsigned	m_nwritten, m_nwrites;
+
+	int	spi_read(unsigned addr, unsigned count, unsigned char *buf);
+	int	spi_write(unsigned addr, unsigned count,
+			const unsigned char *buf);
+public:
+	SX1257(I2CBUS *i2c);
+
+	// Read every register into the shadow, in one burst.  Returns zero
+	// on success.
+	int	load(void);
+	// Forget the shadow, as when the radio has been reset
+	void	invalidate(void);
+
+	// Read a register (of rfaddrbytes(addr) bytes, unless given), straight
+	// from the radio.  The shadow is updated along the way.
+	unsigned	fetch(unsigned addr, unsigned count = 0);
+	// The shadow's copy of a register, as of the last load, fetch, or
+	// commit
+	unsigned	get(unsigned addr, unsigned count = 0) const;
+
+	// Stage a register write, to be made by the next commit()
+	void	set(unsigned addr, unsigned value, unsigned count = 0);
+	// Stage the receive or transmit frequency, in Hz
+	void	set_rx_freq(double hz);
+	void	set_tx_freq(double hz);
+
+	// Write every staged register that differs from the shadow.
+	// Returns zero on success.
+	int	commit(void);
+	// Stage and commit a single register
+	int	write(unsigned addr, unsigned value, unsigned count = 0) {
+		set(addr, value, count);
+		return commit();
+	}
+
+	double	rx_freq(void) const
+		{ return get(RF_REGFRFRXMSB, 3) * SX1257_FSTEP; }
+	double	tx_freq(void) const
+		{ return get(RF_REGFRFTXMSB, 3) * SX1257_FSTEP; }
+
+	// Register bytes written, and SPI write transactions made, so far
+	unsigned	bytes_written(void) const { return m_nwritten; }
+	unsigned	writes(void) const { return m_nwrites; }
+};
+
+#endif	// SX1257_H
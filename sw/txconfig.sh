@@ -8,8 +8,7 @@
 # ./rfregs clkselect	1
 # ./rfregs regmode	0x0c	# Enable transmit/broadcast
 
-./rfregs regmode   0x8d
-./rfregs clkselect 0x92
+./rfregs regmode=0x8d clkselect=0x92
 
 #
 # Turn on the audio, transmitter, and LED